@@ -0,0 +1,82 @@
+#ifndef __BENCH_HPP__
+#define __BENCH_HPP__
+
+#include "node.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+using BenchClock = std::chrono::steady_clock;
+
+// median wall time of f() in milliseconds
+template <typename F> double measure(int iterations, F &&f) {
+  std::vector<double> samples;
+  samples.reserve(iterations);
+  for (int i = 0; i < iterations; ++i) {
+    auto start = BenchClock::now();
+    f();
+    std::chrono::duration<double, std::milli> elapsed =
+        BenchClock::now() - start;
+    samples.push_back(elapsed.count());
+  }
+  std::sort(samples.begin(), samples.end());
+  return samples[samples.size() / 2];
+}
+
+// shape of a benchmark scene
+enum class SceneTopology {
+  // every node is a root
+  Flat,
+  // roots with 9 children each, every child having 10 children of its own
+  Tree,
+  // chains of 100 nodes, each node the only child of the previous one
+  Deep,
+};
+
+struct SceneConfig {
+  const char *name;
+  SceneTopology topology;
+  std::size_t numberOfNodes;
+  // every node has its own mesh instead of all nodes sharing one
+  bool uniqueMeshes;
+};
+
+struct Scene {
+  std::shared_ptr<TransformStore> store = std::make_shared<TransformStore>();
+  std::vector<std::shared_ptr<Node>> roots;
+  // all nodes, depth-first
+  std::vector<Node *> nodes;
+};
+
+Scene buildScene(const SceneConfig &config);
+
+// transform update and node buffer fill on flat, tree and deep scenes of 1k
+// to 100k nodes with shared or unique meshes on the given number of threads,
+// and the record, update_ubo and render pass phases of a headless Engine
+// drawing each scene; the frame phases are skipped when no Vulkan device is
+// available
+void benchScenes(int iterations, unsigned threads);
+
+// vertices per second of a segments x segments sphere on 1..N threads
+void benchMeshGeneration(int segments, int iterations, unsigned maxThreads);
+
+// vertices, triangles and error of each level of detail built by
+// buildLods() and by the shapes' generateLods(), and the time of buildLods()
+void benchMeshSimplification(int iterations);
+
+// frustum culling of every node against the bounding volume hierarchy, its
+// refit as nodes move, and box and ray queries (CPU only)
+void benchSpatialQueries(std::size_t numberOfNodes, int iterations);
+
+// largest angle between unit normals and their octahedral snorm16 encoding
+// decoded again; returns false if it exceeds the expected precision
+bool checkOctahedralRoundTrip();
+
+// per-node vmaCopyMemoryToAllocation against writes into persistently
+// mapped memory; skipped when no Vulkan device is available
+void benchUniformUpload(std::size_t numberOfNodes, int iterations);
+
+#endif
@@ -0,0 +1,66 @@
+// Benchmarks for the scene graph. They do not need a window; the frame
+// phases of the scenes benchmark and the upload benchmark need a Vulkan
+// device.
+
+#include "bench.hpp"
+#include "job_system.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <string_view>
+
+int main(int argc, char **argv) {
+  // usage: scenegraph_bench [--filter name] [--nodes n] [--iterations n]
+  //                         [--threads n]
+  // runs the benchmarks whose name contains the filter: scenes,
+  // spatial-queries, mesh-generation, mesh-simplification,
+  // octahedral-normals and uniform-upload; exits with 1 if a check fails
+  std::string_view filter;
+  std::size_t numberOfNodes = 100000;
+  int iterations = 20;
+  unsigned maxThreads = JobSystem::defaultWorkerCount() + 1;
+  for (int i = 1; i < argc; i += 2) {
+    std::string_view option = argv[i];
+    if (i + 1 == argc) {
+      std::fprintf(stderr, "missing value for option %s\n", argv[i]);
+      return 1;
+    }
+    const char *value = argv[i + 1];
+    if (option == "--filter") {
+      filter = value;
+    } else if (option == "--nodes") {
+      numberOfNodes = std::strtoul(value, nullptr, 10);
+    } else if (option == "--iterations") {
+      iterations = std::max(std::atoi(value), 1);
+    } else if (option == "--threads") {
+      maxThreads = std::max(std::atoi(value), 1);
+    } else {
+      std::fprintf(stderr, "unknown option %s\n", argv[i]);
+      return 1;
+    }
+  }
+  auto selected = [&](std::string_view name) {
+    return name.find(filter) != std::string_view::npos;
+  };
+
+  if (selected("scenes")) {
+    benchScenes(iterations, maxThreads);
+  }
+  if (selected("spatial-queries")) {
+    benchSpatialQueries(numberOfNodes, iterations);
+  }
+  if (selected("mesh-generation")) {
+    benchMeshGeneration(2048, std::min(iterations, 5), maxThreads);
+  }
+  if (selected("mesh-simplification")) {
+    benchMeshSimplification(std::min(iterations, 5));
+  }
+  bool passed = true;
+  if (selected("octahedral-normals")) {
+    passed = checkOctahedralRoundTrip() && passed;
+  }
+  if (selected("uniform-upload")) {
+    benchUniformUpload(numberOfNodes, iterations);
+  }
+  return passed ? 0 : 1;
+}
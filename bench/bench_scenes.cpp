@@ -0,0 +1,189 @@
+// Scene-scale benchmarks: the per-frame work of the engine on scenes of
+// different sizes, shapes and mesh sharing. The transform update and node
+// buffer fill run on the CPU alone; the frame phases are measured by a
+// headless Engine and skipped when no Vulkan device is available.
+
+#include "bench.hpp"
+#include "common.hpp"
+#include "engine.hpp"
+#include "job_system.hpp"
+#include "mesh.hpp"
+#include "shapes/mesh_sphere.hpp"
+#include "uniforms.hpp"
+
+#include <cstdio>
+#include <exception>
+#include <vector>
+
+namespace {
+
+// nodes per chain of a SceneTopology::Deep scene
+constexpr std::size_t DEEP_CHAIN_LENGTH = 100;
+
+std::shared_ptr<Mesh> makeMesh() { return Sphere::generate(0.5f, 4, 3); }
+
+// average time of the frame phases of a headless Engine, in milliseconds
+struct FrameTimings {
+  std::size_t numberOfVisibleNodes = 0;
+  double record = 0.0;
+  double updateUbo = 0.0;
+  double renderPass = 0.0;
+};
+
+// render the scene with a headless Engine; false if it could not be prepared,
+// e.g. because there is no Vulkan device
+bool renderScene(const Scene &scene, unsigned threads, int frames,
+                 FrameTimings &timings) {
+  Engine engine(threads - 1);
+  engine.setHeadless(true);
+  engine.setTransformStore(scene.store);
+  for (const auto &root : scene.roots) {
+    engine.addNode(root);
+  }
+  try {
+    engine.prepare();
+  } catch (const std::exception &e) {
+    std::printf("scenes: frame phases skipped, %s\n", e.what());
+    return false;
+  }
+  engine.renderFrames(frames);
+
+  const Profiler &profiler = engine.profiler();
+  timings.numberOfVisibleNodes = engine.drawStats().numberOfNodes;
+  timings.record = profiler.stats("record").average;
+  timings.updateUbo = profiler.stats("update_ubo").average;
+  timings.renderPass =
+      profiler.stats("render pass", Profiler::Track::Gpu).average;
+  return true;
+}
+
+} // namespace
+
+Scene buildScene(const SceneConfig &config) {
+  Scene scene;
+  auto sharedMesh = makeMesh();
+  auto makeNode = [&] {
+    return std::make_shared<Node>(scene.store, config.uniqueMeshes
+                                                   ? makeMesh()
+                                                   : sharedMesh);
+  };
+
+  switch (config.topology) {
+  case SceneTopology::Flat:
+    for (std::size_t i = 0; i < config.numberOfNodes; ++i) {
+      auto node = makeNode();
+      node->setPosition(glm::vec3(static_cast<float>(i % 100),
+                                  static_cast<float>(i / 100), 0.0f));
+      scene.roots.push_back(node);
+    }
+    break;
+  case SceneTopology::Tree: {
+    std::size_t numberOfRoots =
+        std::max<std::size_t>(config.numberOfNodes / 100, 1);
+    for (std::size_t r = 0; r < numberOfRoots; ++r) {
+      auto root = makeNode();
+      root->setPosition(glm::vec3(static_cast<float>(r), 0.0f, 0.0f));
+      for (int c = 0; c < 9; ++c) {
+        auto child = makeNode();
+        child->setPosition(glm::vec3(0.0f, static_cast<float>(c), 0.0f));
+        root->addChild(child);
+        for (int g = 0; g < 10; ++g) {
+          auto grandChild = makeNode();
+          grandChild->setPosition(
+              glm::vec3(0.0f, 0.0f, static_cast<float>(g)));
+          grandChild->setEulerAngle(glm::vec3(0.1f * g, 0.0f, 0.0f));
+          child->addChild(grandChild);
+        }
+      }
+      scene.roots.push_back(root);
+    }
+    break;
+  }
+  case SceneTopology::Deep: {
+    std::size_t numberOfChains =
+        std::max<std::size_t>(config.numberOfNodes / DEEP_CHAIN_LENGTH, 1);
+    for (std::size_t r = 0; r < numberOfChains; ++r) {
+      auto root = makeNode();
+      root->setPosition(glm::vec3(static_cast<float>(r), 0.0f, 0.0f));
+      Node *parent = root.get();
+      for (std::size_t d = 1; d < DEEP_CHAIN_LENGTH; ++d) {
+        auto child = makeNode();
+        child->setPosition(glm::vec3(0.0f, 0.0f, 0.1f));
+        child->setEulerAngle(glm::vec3(0.01f * d, 0.0f, 0.0f));
+        parent->addChild(child);
+        parent = child.get();
+      }
+      scene.roots.push_back(root);
+    }
+    break;
+  }
+  }
+
+  for (const auto &root : scene.roots) {
+    for (auto &node : root->depthFirst()) {
+      scene.nodes.push_back(&node);
+    }
+  }
+  return scene;
+}
+
+void benchScenes(int iterations, unsigned threads) {
+  const SceneConfig configs[] = {
+      {"flat 1k", SceneTopology::Flat, 1000, false},
+      {"flat 10k", SceneTopology::Flat, 10000, false},
+      {"flat 100k", SceneTopology::Flat, 100000, false},
+      {"flat 100k unique", SceneTopology::Flat, 100000, true},
+      {"tree 100k", SceneTopology::Tree, 100000, false},
+      {"tree 100k unique", SceneTopology::Tree, 100000, true},
+      {"deep 100k", SceneTopology::Deep, 100000, false},
+  };
+
+  // the engine logs every change of the drawn scene
+  auto logLevel = spdlog::get_level();
+  spdlog::set_level(spdlog::level::warn);
+
+  JobSystem jobs(threads - 1);
+  std::printf("scenes: %u threads, median of %d iterations, frame phases "
+              "averaged over %d frames\n",
+              jobs.threadCount(), iterations, iterations);
+  std::printf("%-18s %8s %10s %10s %10s %8s %10s %10s %10s\n", "scene",
+              "nodes", "build ms", "update ms", "fill ms", "visible",
+              "record ms", "ubo ms", "gpu ms");
+  bool hasDevice = true;
+  for (const auto &config : configs) {
+    auto start = BenchClock::now();
+    Scene scene = buildScene(config);
+    scene.store->update(&jobs);
+    std::chrono::duration<double, std::milli> build =
+        BenchClock::now() - start;
+
+    // moving every root dirties the whole scene
+    float angle = 0.0f;
+    double update = measure(iterations, [&] {
+      angle += 0.01f;
+      for (const auto &root : scene.roots) {
+        root->setEulerAngle(glm::vec3(0.0f, 0.0f, angle));
+      }
+      scene.store->update(&jobs);
+    });
+
+    std::vector<NodeUniforms> buffer(scene.nodes.size());
+    double fill = measure(iterations, [&] {
+      writeNodeUniforms(jobs, scene.nodes, buffer.data());
+    });
+
+    FrameTimings frame;
+    hasDevice = hasDevice && renderScene(scene, threads, iterations, frame);
+
+    std::printf("%-18s %8zu %10.3f %10.3f %10.3f", config.name,
+                scene.nodes.size(), build.count(), update, fill);
+    if (hasDevice) {
+      std::printf(" %8zu %10.3f %10.3f %10.3f\n", frame.numberOfVisibleNodes,
+                  frame.record, frame.updateUbo, frame.renderPass);
+    } else {
+      std::printf(" %8s %10s %10s %10s\n", "-", "-", "-", "-");
+    }
+  }
+
+  spdlog::set_level(logLevel);
+}
@@ -0,0 +1,98 @@
+// Procedural mesh generation throughput: a finely tessellated sphere built on
+// 1..N threads. Also the levels of detail of the shapes, from the generic
+// simplifier and from their own coarser tessellations.
+
+#include "bench.hpp"
+#include "job_system.hpp"
+#include "mesh_simplifier.hpp"
+#include "shapes/mesh_box.hpp"
+#include "shapes/mesh_cone.hpp"
+#include "shapes/mesh_plane.hpp"
+#include "shapes/mesh_sphere.hpp"
+
+#include <cstdio>
+#include <vector>
+
+void benchMeshGeneration(int segments, int iterations, unsigned maxThreads) {
+  std::vector<unsigned> threadCounts;
+  for (unsigned t = 1; t < maxThreads; t *= 2) {
+    threadCounts.push_back(t);
+  }
+  threadCounts.push_back(maxThreads);
+
+  std::size_t numberOfVertices = 0;
+  std::size_t numberOfTriangles = 0;
+  {
+    auto mesh = Sphere::generate(1.0f, segments, segments);
+    numberOfVertices = mesh->size();
+    numberOfTriangles = mesh->numberOfIndices() / 3;
+  }
+
+  std::printf("mesh generation: %dx%d sphere, %zu vertices, %zu triangles\n",
+              segments, segments, numberOfVertices, numberOfTriangles);
+  std::printf("%8s %12s %14s %9s\n", "threads", "ms", "Mvertices/s",
+              "speedup");
+  double baseline = 0.0;
+  for (unsigned threads : threadCounts) {
+    JobSystem jobs(threads - 1);
+    double elapsed = measure(iterations, [&] {
+      auto mesh = Sphere::generate(1.0f, segments, segments, &jobs);
+    });
+    if (baseline == 0.0) {
+      baseline = elapsed;
+    }
+    std::printf("%8u %12.3f %14.2f %8.2fx\n", threads, elapsed,
+                numberOfVertices / (elapsed * 1000.0), baseline / elapsed);
+  }
+}
+
+namespace {
+
+void printLods(const char *name, const Mesh &mesh) {
+  for (std::size_t level = 0; level < mesh.numberOfLods(); ++level) {
+    const Mesh &lod = mesh.lod(level);
+    std::printf("%-22s %6zu %10zu %10zu %10.4f\n", level == 0 ? name : "",
+                level, lod.size(), lod.numberOfIndices() / 3,
+                mesh.lodError(level));
+  }
+}
+
+} // namespace
+
+void benchMeshSimplification(int iterations) {
+  std::printf("mesh simplification: levels of detail by vertex clustering "
+              "and by tessellation\n");
+  std::printf("%-22s %6s %10s %10s %10s\n", "mesh", "level", "vertices",
+              "triangles", "error");
+
+  // the generic simplifier on meshes of each shape
+  auto sphere = Sphere::generate(1.0f, 128, 128);
+  double elapsed = measure(iterations, [&] {
+    auto mesh = std::make_shared<Mesh>(
+        std::vector<Vertex>(sphere->vertices().begin(),
+                            sphere->vertices().end()),
+        std::vector<IndexType>(sphere->indices().begin(),
+                               sphere->indices().end()));
+    buildLods(*mesh, 4);
+  });
+  buildLods(*sphere, 4);
+  printLods("sphere, clustered", *sphere);
+  auto cone = Cone::generate(2.0f, 0.5f, 1.0f, UpAxis::Y, 128, 32, false);
+  buildLods(*cone, 4);
+  printLods("cone, clustered", *cone);
+  auto box = Box::generate({1.0f, 1.0f, 1.0f}, 64, 64);
+  buildLods(*box, 4);
+  printLods("box, clustered", *box);
+
+  // the shapes' own coarser tessellations
+  printLods("sphere, tessellated", *Sphere::generateLods(1.0f, 128, 128, 4));
+  printLods("cone, tessellated",
+            *Cone::generateLods(2.0f, 0.5f, 1.0f, UpAxis::Y, 128, 32, false,
+                                4));
+  printLods("box, tessellated",
+            *Box::generateLods({1.0f, 1.0f, 1.0f}, 64, 64, 4));
+  printLods("plane, tessellated",
+            *Plane::generateLods(2.0f, 2.0f, UpAxis::Z, 64, 64, 4));
+
+  std::printf("buildLods of the 128x128 sphere: %.3f ms\n", elapsed);
+}
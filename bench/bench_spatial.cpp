@@ -0,0 +1,121 @@
+// Spatial queries over node bounds: culling every node against the frustum
+// compared to culling through the bounding volume hierarchy, the cost of
+// keeping the hierarchy up to date as nodes move, and box and ray queries.
+
+#include "bench.hpp"
+#include "bvh.hpp"
+#include "frustum.hpp"
+#include "job_system.hpp"
+#include "shapes/mesh_sphere.hpp"
+
+#include <cstdio>
+#include <random>
+#include <vector>
+
+namespace {
+
+// nodes are scattered over a cube of this edge length
+constexpr float SCENE_EXTENT = 1000.0f;
+// rays cast per iteration of the ray benchmark
+constexpr int NUMBER_OF_RAYS = 1000;
+
+} // namespace
+
+void benchSpatialQueries(std::size_t numberOfNodes, int iterations) {
+  Scene scene;
+  auto mesh = Sphere::generate(0.5f, 4, 3);
+  std::mt19937 random(1);
+  std::uniform_real_distribution<float> coordinate(-SCENE_EXTENT * 0.5f,
+                                                   SCENE_EXTENT * 0.5f);
+  auto randomPosition = [&] {
+    return glm::vec3(coordinate(random), coordinate(random),
+                     coordinate(random));
+  };
+  for (std::size_t i = 0; i < numberOfNodes; ++i) {
+    auto node = std::make_shared<Node>(scene.store, mesh);
+    node->setPosition(randomPosition());
+    scene.roots.push_back(node);
+    scene.nodes.push_back(node.get());
+  }
+  JobSystem jobs;
+  scene.store->update(&jobs);
+
+  // a camera at the edge of the scene, looking at its centre
+  glm::mat4 proj = glm::perspective(glm::radians(45.0f), 16.0f / 9.0f, 0.1f,
+                                    SCENE_EXTENT);
+  proj[1][1] *= -1;
+  glm::mat4 view = glm::lookAt(glm::vec3(0.0f, 0.0f, SCENE_EXTENT * 0.5f),
+                               glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+  Frustum frustum = Frustum::fromMatrix(proj * view);
+
+  std::printf("spatial queries: %zu nodes, median of %d iterations\n",
+              scene.nodes.size(), iterations);
+  std::printf("%-24s %10s %10s\n", "query", "ms", "results");
+
+  // every node's world sphere against the planes
+  std::vector<glm::vec4> spheres(scene.nodes.size());
+  std::vector<uint8_t> visible(scene.nodes.size());
+  std::size_t numberOfVisible = 0;
+  double flat = measure(iterations, [&] {
+    for (std::size_t i = 0; i < scene.nodes.size(); ++i) {
+      BoundingSphere sphere = scene.nodes[i]->worldBoundingSphere();
+      spheres[i] = glm::vec4(sphere.center, sphere.radius);
+    }
+    numberOfVisible = cullSpheres(frustum, spheres, visible.data());
+  });
+  std::printf("%-24s %10.3f %10zu\n", "cull every node", flat,
+              numberOfVisible);
+
+  Bvh bvh;
+  double build = measure(iterations, [&] { bvh.build(scene.nodes); });
+  std::printf("%-24s %10.3f %10zu\n", "bvh build", build, bvh.size());
+
+  std::vector<Node *> result;
+  double cull = measure(iterations, [&] {
+    result.clear();
+    bvh.query(frustum, result);
+  });
+  std::printf("%-24s %10.3f %10zu\n", "bvh cull", cull, result.size());
+
+  // the refit follows the moved nodes only, until most of them move
+  for (double fraction : {0.001, 0.01, 0.1, 1.0}) {
+    std::size_t moved = static_cast<std::size_t>(fraction * numberOfNodes);
+    double refit = measure(iterations, [&] {
+      for (std::size_t i = 0; i < moved; ++i) {
+        scene.nodes[random() % scene.nodes.size()]->setPosition(
+            randomPosition());
+      }
+      scene.store->update(&jobs);
+      bvh.refit(*scene.store);
+    });
+    char name[32];
+    std::snprintf(name, sizeof(name), "move + refit %g%%", fraction * 100.0);
+    std::printf("%-24s %10.3f %10zu\n", name, refit, moved);
+  }
+
+  // the moves above loosened the tree
+  bvh.build(scene.nodes);
+
+  BoundingBox box;
+  box.expand(glm::vec3(-SCENE_EXTENT * 0.05f));
+  box.expand(glm::vec3(SCENE_EXTENT * 0.05f));
+  double boxQuery = measure(iterations, [&] {
+    result.clear();
+    bvh.query(box, result);
+  });
+  std::printf("%-24s %10.3f %10zu\n", "bvh box query", boxQuery,
+              result.size());
+
+  std::vector<std::pair<glm::vec3, glm::vec3>> rays(NUMBER_OF_RAYS);
+  for (auto &ray : rays) {
+    ray = {randomPosition(), glm::normalize(randomPosition())};
+  }
+  std::size_t hits = 0;
+  double raycast = measure(iterations, [&] {
+    hits = 0;
+    for (const auto &[origin, direction] : rays) {
+      hits += bvh.raycast(origin, direction).node != nullptr;
+    }
+  });
+  std::printf("%-24s %10.3f %10zu\n", "bvh 1000 rays", raycast, hits);
+}
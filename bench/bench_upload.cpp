@@ -0,0 +1,146 @@
+// Compares the two ways of filling the per-frame node buffer: one
+// vmaCopyMemoryToAllocation per node, and plain writes into a persistently
+// mapped allocation followed by a single flush.
+
+#include "bench.hpp"
+#include "common.hpp"
+#include "uniforms.hpp"
+
+#include <VkBootstrap.h>
+#include <vulkan/vk_enum_string_helper.h>
+
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+namespace {
+
+// headless instance, device and allocator; nothing is presented
+struct HeadlessDevice {
+  vkb::Instance instance;
+  vkb::Device device;
+  VmaAllocator allocator = VK_NULL_HANDLE;
+
+  ~HeadlessDevice() {
+    if (allocator != VK_NULL_HANDLE) {
+      vmaDestroyAllocator(allocator);
+    }
+    if (device.device != VK_NULL_HANDLE) {
+      vkb::destroy_device(device);
+    }
+    if (instance.instance != VK_NULL_HANDLE) {
+      vkb::destroy_instance(instance);
+    }
+  }
+
+  bool init() {
+    if (volkInitialize() != VK_SUCCESS) {
+      return false;
+    }
+    auto inst_ret = vkb::InstanceBuilder()
+                        .set_app_name("scenegraph_bench")
+                        .set_headless()
+                        .require_api_version(VK_MAKE_VERSION(1, 3, 0))
+                        .build();
+    if (!inst_ret) {
+      return false;
+    }
+    instance = inst_ret.value();
+    volkLoadInstance(instance);
+
+    auto phys_ret = vkb::PhysicalDeviceSelector(instance)
+                        .set_minimum_version(1, 3)
+                        .require_present(false)
+                        .select();
+    if (!phys_ret) {
+      return false;
+    }
+    auto dev_ret = vkb::DeviceBuilder(phys_ret.value()).build();
+    if (!dev_ret) {
+      return false;
+    }
+    device = dev_ret.value();
+    volkLoadDevice(device);
+
+    VmaVulkanFunctions functions{
+        .vkGetInstanceProcAddr = vkGetInstanceProcAddr,
+        .vkGetDeviceProcAddr = vkGetDeviceProcAddr,
+    };
+    VmaAllocatorCreateInfo createInfo{
+        .physicalDevice = phys_ret.value(),
+        .device = device,
+        .pVulkanFunctions = &functions,
+        .instance = instance,
+    };
+    return vmaCreateAllocator(&createInfo, &allocator) == VK_SUCCESS;
+  }
+};
+
+} // namespace
+
+void benchUniformUpload(std::size_t numberOfNodes, int iterations) {
+  HeadlessDevice headless;
+  if (!headless.init()) {
+    std::printf("uniform upload: skipped, no Vulkan device\n");
+    return;
+  }
+
+  // same allocation flags as Engine::create_node_buffer()
+  VkBufferCreateInfo bufferCreateInfo{};
+  bufferCreateInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+  bufferCreateInfo.size = numberOfNodes * sizeof(NodeUniforms);
+  bufferCreateInfo.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+  bufferCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+  VmaAllocationCreateInfo allocationCreateInfo{};
+  allocationCreateInfo.flags =
+      VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT |
+      VMA_ALLOCATION_CREATE_MAPPED_BIT;
+  allocationCreateInfo.usage = VMA_MEMORY_USAGE_AUTO;
+
+  VkBuffer buffer = VK_NULL_HANDLE;
+  VmaAllocation allocation = VK_NULL_HANDLE;
+  VmaAllocationInfo allocationInfo{};
+  VK_CHECK(vmaCreateBuffer(headless.allocator, &bufferCreateInfo,
+                           &allocationCreateInfo, &buffer, &allocation,
+                           &allocationInfo));
+  auto *mapped = static_cast<std::byte *>(allocationInfo.pMappedData);
+
+  VkMemoryPropertyFlags memoryProperties = 0;
+  vmaGetAllocationMemoryProperties(headless.allocator, allocation,
+                                   &memoryProperties);
+  bool coherent = memoryProperties & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+
+  std::vector<NodeUniforms> source(numberOfNodes);
+  for (std::size_t i = 0; i < numberOfNodes; ++i) {
+    float f = static_cast<float>(i);
+    source[i].rows[0] = glm::vec4(1.0f, 0.0f, 0.0f, f);
+    source[i].rows[1] = glm::vec4(0.0f, 1.0f, 0.0f, 0.0f);
+    source[i].rows[2] = glm::vec4(0.0f, 0.0f, 1.0f, 0.0f);
+  }
+
+  double copyPerNode = measure(iterations, [&] {
+    for (std::size_t i = 0; i < numberOfNodes; ++i) {
+      VK_CHECK(vmaCopyMemoryToAllocation(headless.allocator, &source[i],
+                                         allocation, i * sizeof(NodeUniforms),
+                                         sizeof(NodeUniforms)));
+    }
+  });
+  double mappedWrite = measure(iterations, [&] {
+    for (std::size_t i = 0; i < numberOfNodes; ++i) {
+      std::memcpy(mapped + i * sizeof(NodeUniforms), &source[i],
+                  sizeof(NodeUniforms));
+    }
+    VK_CHECK(vmaFlushAllocation(headless.allocator, allocation, 0,
+                                VK_WHOLE_SIZE));
+  });
+
+  std::printf("uniform upload: %zu nodes, %s memory\n", numberOfNodes,
+              coherent ? "host-coherent" : "non-coherent");
+  std::printf("%28s %12s\n", "path", "ms");
+  std::printf("%28s %12.3f\n", "vmaCopyMemoryToAllocation", copyPerNode);
+  std::printf("%28s %12.3f\n", "mapped write + 1 flush", mappedWrite);
+  std::printf("%28s %11.2fx\n", "speedup", copyPerNode / mappedWrite);
+
+  vmaDestroyBuffer(headless.allocator, buffer, allocation);
+}
@@ -0,0 +1,51 @@
+// Round trip of normals through the octahedral snorm16 encoding of the
+// compact vertex layout; shaders/triangle.vert decodes them like
+// octahedralDecode().
+
+#include "bench.hpp"
+#include "vertex_format.hpp"
+
+#include <glm/gtc/packing.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <random>
+
+namespace {
+
+// largest angle between a normal and its decoded encoding, in degrees; two
+// snorm16 components resolve well below a hundredth of a degree
+constexpr float MAX_ERROR_DEGREES = 0.01f;
+
+} // namespace
+
+bool checkOctahedralRoundTrip() {
+  std::mt19937 random(1);
+  std::normal_distribution<float> component;
+  std::vector<glm::vec3> normals = {
+      {1, 0, 0},  {-1, 0, 0}, {0, 1, 0},  {0, -1, 0},
+      {0, 0, 1},  {0, 0, -1}, {1, 1, -1}, {-1, -1, -1},
+  };
+  for (int i = 0; i < 100000; ++i) {
+    normals.emplace_back(component(random), component(random),
+                         component(random));
+  }
+
+  float maxError = 0.0f;
+  for (glm::vec3 normal : normals) {
+    normal = glm::normalize(normal);
+    uint32_t packed = glm::packSnorm2x16(octahedralEncode(normal));
+    glm::vec3 decoded = octahedralDecode(glm::unpackSnorm2x16(packed));
+    // from the chord, which unlike the dot product keeps its precision for
+    // nearly equal vectors
+    float chord = std::min(glm::distance(normal, decoded), 2.0f);
+    maxError =
+        std::max(maxError, glm::degrees(2.0f * std::asin(chord * 0.5f)));
+  }
+
+  bool passed = maxError <= MAX_ERROR_DEGREES;
+  std::printf("octahedral normals: %zu normals, max error %.5f degrees: %s\n",
+              normals.size(), maxError, passed ? "ok" : "FAILED");
+  return passed;
+}
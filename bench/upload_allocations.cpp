@@ -0,0 +1,67 @@
+// Counts the heap allocations of prepareGeometryUpload(), which
+// Engine::upload_mesh() uses to convert every level of detail of a mesh
+// before it is copied to the staging ring. Once the conversion arrays have
+// grown to fit, it may not allocate, so no mesh data is copied. Replacing
+// the global operator new affects the whole binary, so the check is an
+// executable of its own; it exits with 1 if there are any allocations.
+
+#include "shapes/mesh_sphere.hpp"
+#include "vertex_format.hpp"
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <vector>
+
+namespace {
+
+std::atomic<std::size_t> numberOfAllocations{0};
+
+} // namespace
+
+// every allocation of the binary goes through these
+void *operator new(std::size_t size) {
+  numberOfAllocations.fetch_add(1, std::memory_order_relaxed);
+  if (void *p = std::malloc(size == 0 ? 1 : size)) {
+    return p;
+  }
+  throw std::bad_alloc();
+}
+
+void *operator new[](std::size_t size) { return ::operator new(size); }
+
+void operator delete(void *p) noexcept { std::free(p); }
+void operator delete[](void *p) noexcept { std::free(p); }
+void operator delete(void *p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void *p, std::size_t) noexcept { std::free(p); }
+
+int main() {
+  auto mesh = Sphere::generateLods(1.0f, 256, 128, 4);
+  std::vector<GpuVertex> encodedVertices;
+  std::vector<uint16_t> shortIndices;
+
+  std::size_t bytes = 0;
+  auto prepare = [&] {
+    for (std::size_t level = 0; level < mesh->numberOfLods(); ++level) {
+      const Mesh &lod = mesh->lod(level);
+      GeometryUpload geometry = prepareGeometryUpload(
+          lod, lod.hasShortIndices(), encodedVertices, shortIndices);
+      bytes += geometry.vertices.size_bytes() + geometry.indices.size_bytes();
+    }
+  };
+
+  // the first pass grows the conversion arrays to the finest level
+  prepare();
+  bytes = 0;
+  std::size_t before = numberOfAllocations.load(std::memory_order_relaxed);
+  prepare();
+  std::size_t allocations =
+      numberOfAllocations.load(std::memory_order_relaxed) - before;
+
+  std::printf("upload allocations: %zu levels, %zu bytes, %zu allocations: "
+              "%s\n",
+              mesh->numberOfLods(), bytes, allocations,
+              allocations == 0 ? "ok" : "FAILED");
+  return allocations == 0 ? 0 : 1;
+}
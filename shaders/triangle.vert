@@ -1,20 +1,58 @@
 #version 450
 
-layout(binding = 0) uniform UniformBufferObject {
+layout(binding = 0) uniform CameraUniforms {
+  mat4 view;
+  mat4 proj;
+  mat4 viewProj;
   vec4 light;
-  mat4 mvpMatrix;
-} ubo;
+} camera;
+
+struct NodeData {
+  // upper 3x4 part of the world matrix, stored row by row
+  mat3x4 model;
+  vec4 color;
+};
+
+layout(std430, binding = 1) readonly buffer NodeUniforms {
+  NodeData data[];
+} nodes;
 
 layout(location = 0) in vec3 in_position;
+#ifdef VERTEX_LAYOUT_COMPACT
+// octahedral-encoded normal, see src/vertex_format.cpp
+layout(location = 1) in vec2 in_normal;
+#else
 layout(location = 1) in vec3 in_normal;
+#endif
+#ifdef VERTEX_COLOR
 layout(location = 2) in vec3 in_color;
+#endif
 
 layout(location = 0) out vec3 out_color;
 layout(location = 1) out float out_lightIntensity;
 
+vec3 decodeNormal()
+{
+#ifdef VERTEX_LAYOUT_COMPACT
+  vec3 n = vec3(in_normal, 1.0 - abs(in_normal.x) - abs(in_normal.y));
+  float t = max(-n.z, 0.0);
+  n.xy += vec2(n.x >= 0.0 ? -t : t, n.y >= 0.0 ? -t : t);
+  return normalize(n);
+#else
+  return in_normal;
+#endif
+}
+
 void main()
 {
-  gl_Position = ubo.mvpMatrix * vec4(in_position, 1.0);
-  out_lightIntensity = max(0.0, dot(in_normal, ubo.light.xyz)) + ubo.light.w;
-  out_color = in_color;
-}
\ No newline at end of file
+  // firstInstance of the draw is the index of the node
+  NodeData node = nodes.data[gl_InstanceIndex];
+  vec3 worldPosition = vec4(in_position, 1.0) * node.model;
+  gl_Position = camera.viewProj * vec4(worldPosition, 1.0);
+  out_lightIntensity = max(0.0, dot(decodeNormal(), camera.light.xyz)) + camera.light.w;
+#ifdef VERTEX_COLOR
+  out_color = node.color.rgb * in_color;
+#else
+  out_color = node.color.rgb;
+#endif
+}
@@ -0,0 +1,350 @@
+#include "bvh.hpp"
+#include "node.hpp"
+#include "transform_store.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <utility>
+
+namespace {
+
+bool sameBox(const BoundingBox &a, const BoundingBox &b) {
+  return a.min == b.min && a.max == b.max;
+}
+
+bool overlaps(const BoundingBox &a, const BoundingBox &b) {
+  return a.min.x <= b.max.x && a.max.x >= b.min.x && a.min.y <= b.max.y &&
+         a.max.y >= b.min.y && a.min.z <= b.max.z && a.max.z >= b.min.z;
+}
+
+bool contains(const BoundingBox &outer, const BoundingBox &inner) {
+  return outer.min.x <= inner.min.x && outer.max.x >= inner.max.x &&
+         outer.min.y <= inner.min.y && outer.max.y >= inner.max.y &&
+         outer.min.z <= inner.min.z && outer.max.z >= inner.max.z;
+}
+
+// clear the bits of planes that box is entirely inside of; returns false if
+// box is entirely outside of one of them
+bool clipPlanes(const Frustum &frustum, const BoundingBox &box,
+                uint32_t &planeMask) {
+  glm::vec3 center = box.center();
+  glm::vec3 extents = box.extents();
+  for (uint32_t p = 0; p < frustum.planes.size(); ++p) {
+    if ((planeMask & (1u << p)) == 0) {
+      continue;
+    }
+    const glm::vec4 &plane = frustum.planes[p];
+    glm::vec3 normal(plane);
+    float distance = glm::dot(normal, center) + plane.w;
+    float radius = glm::dot(glm::abs(normal), extents);
+    if (distance + radius < 0.0f) {
+      return false;
+    }
+    if (distance - radius >= 0.0f) {
+      planeMask &= ~(1u << p);
+    }
+  }
+  return true;
+}
+
+// if the ray enters box within [0, maxDistance], set distance to where
+bool intersectRay(const BoundingBox &box, const glm::vec3 &origin,
+                  const glm::vec3 &inverseDirection, float maxDistance,
+                  float &distance) {
+  float tMin = 0.0f;
+  float tMax = maxDistance;
+  for (int axis = 0; axis < 3; ++axis) {
+    float t0 = (box.min[axis] - origin[axis]) * inverseDirection[axis];
+    float t1 = (box.max[axis] - origin[axis]) * inverseDirection[axis];
+    if (t0 > t1) {
+      std::swap(t0, t1);
+    }
+    tMin = std::max(tMin, t0);
+    tMax = std::min(tMax, t1);
+  }
+  // tMin is infinite if the ray runs parallel to and outside of a slab
+  if (tMin > tMax || std::isinf(tMin)) {
+    return false;
+  }
+  distance = tMin;
+  return true;
+}
+
+glm::vec4 worldSphere(const Node &node) {
+  BoundingSphere sphere = node.worldBoundingSphere();
+  return glm::vec4(sphere.center, sphere.radius);
+}
+
+} // namespace
+
+void Bvh::build(std::span<Node *const> nodes) {
+  m_nodes.assign(nodes.begin(), nodes.end());
+  m_meshes.clear();
+  m_items.clear();
+  m_spheres.clear();
+  m_tree.clear();
+  m_itemOfHandle.clear();
+  for (Node *node : nodes) {
+    m_meshes.push_back(node->mesh().get());
+    m_items.push_back({node, node->worldBoundingBox(), 0});
+  }
+  if (m_items.empty()) {
+    return;
+  }
+  // the boxes above brought the world matrices up to date
+  m_updateCount = nodes.front()->transformStore()->updateCount();
+
+  m_tree.reserve(2 * (m_items.size() / LEAF_SIZE) + 1);
+  buildRange(0, static_cast<uint32_t>(m_items.size()), InvalidIndex);
+
+  // in the order of the items after the splits
+  m_spheres.reserve(m_items.size());
+  for (const Item &item : m_items) {
+    m_spheres.push_back(worldSphere(*item.node));
+  }
+
+  for (uint32_t i = 0; i < m_items.size(); ++i) {
+    TransformStore::Handle handle = m_items[i].node->transformHandle();
+    if (handle >= m_itemOfHandle.size()) {
+      m_itemOfHandle.resize(handle + 1, InvalidIndex);
+    }
+    m_itemOfHandle[handle] = i;
+  }
+}
+
+uint32_t Bvh::buildRange(uint32_t first, uint32_t count, uint32_t parent) {
+  uint32_t index = static_cast<uint32_t>(m_tree.size());
+  m_tree.push_back({{}, first, count, 0, parent});
+
+  BoundingBox box;
+  BoundingBox centers;
+  for (uint32_t i = first; i < first + count; ++i) {
+    box.expand(m_items[i].box);
+    centers.expand(m_items[i].box.center());
+  }
+  m_tree[index].box = box;
+  if (count <= LEAF_SIZE) {
+    for (uint32_t i = first; i < first + count; ++i) {
+      m_items[i].leaf = index;
+    }
+    return index;
+  }
+
+  // split at the median along the axis in which the centres spread most
+  glm::vec3 spread = centers.max - centers.min;
+  int axis = spread.x >= spread.y && spread.x >= spread.z ? 0
+             : spread.y >= spread.z                      ? 1
+                                                         : 2;
+  uint32_t half = count / 2;
+  std::nth_element(m_items.begin() + first, m_items.begin() + first + half,
+                   m_items.begin() + first + count,
+                   [axis](const Item &a, const Item &b) {
+                     return a.box.center()[axis] < b.box.center()[axis];
+                   });
+  buildRange(first, half, index);
+  uint32_t right = buildRange(first + half, count - half, index);
+  m_tree[index].right = right;
+  return index;
+}
+
+bool Bvh::matches(std::span<Node *const> nodes) const {
+  if (nodes.size() != m_nodes.size()) {
+    return false;
+  }
+  for (std::size_t i = 0; i < nodes.size(); ++i) {
+    if (nodes[i] != m_nodes[i] || nodes[i]->mesh().get() != m_meshes[i]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void Bvh::refit(const TransformStore &store) {
+  if (m_items.empty() || store.updateCount() == m_updateCount) {
+    return;
+  }
+  const auto &changed = store.changedHandles();
+  // walking up from many leaves costs more than one pass over the tree
+  if (store.updateCount() != m_updateCount + 1 ||
+      changed.size() > m_items.size() / 4) {
+    refitAll();
+  } else {
+    for (TransformStore::Handle handle : changed) {
+      uint32_t item = handle < m_itemOfHandle.size() ? m_itemOfHandle[handle]
+                                                     : InvalidIndex;
+      if (item == InvalidIndex) {
+        continue;
+      }
+      m_items[item].box = m_items[item].node->worldBoundingBox();
+      m_spheres[item] = worldSphere(*m_items[item].node);
+      refitPath(m_items[item].leaf);
+    }
+  }
+  m_updateCount = store.updateCount();
+}
+
+void Bvh::refitPath(uint32_t leaf) {
+  TreeNode &node = m_tree[leaf];
+  node.box = {};
+  for (uint32_t i = node.first; i < node.first + node.count; ++i) {
+    node.box.expand(m_items[i].box);
+  }
+  for (uint32_t index = node.parent; index != InvalidIndex;
+       index = m_tree[index].parent) {
+    TreeNode &parent = m_tree[index];
+    BoundingBox box = m_tree[index + 1].box;
+    box.expand(m_tree[parent.right].box);
+    if (sameBox(box, parent.box)) {
+      break;
+    }
+    parent.box = box;
+  }
+}
+
+void Bvh::refitAll() {
+  for (std::size_t i = 0; i < m_items.size(); ++i) {
+    m_items[i].box = m_items[i].node->worldBoundingBox();
+    m_spheres[i] = worldSphere(*m_items[i].node);
+  }
+  // children follow their parents, so a reverse sweep visits them first
+  for (std::size_t index = m_tree.size(); index-- > 0;) {
+    TreeNode &node = m_tree[index];
+    node.box = {};
+    if (node.right == 0) {
+      for (uint32_t i = node.first; i < node.first + node.count; ++i) {
+        node.box.expand(m_items[i].box);
+      }
+    } else {
+      node.box.expand(m_tree[index + 1].box);
+      node.box.expand(m_tree[node.right].box);
+    }
+  }
+}
+
+void Bvh::addRange(const TreeNode &node, std::vector<Node *> &result) const {
+  for (uint32_t i = node.first; i < node.first + node.count; ++i) {
+    result.push_back(m_items[i].node);
+  }
+}
+
+void Bvh::query(const Frustum &frustum, std::vector<Node *> &result) const {
+  if (m_tree.empty()) {
+    return;
+  }
+  // the nodes of leaves that are partly inside are tested together
+  // afterwards, so that cullSpheres() gets full batches
+  m_candidateNodes.clear();
+  m_candidateSpheres.clear();
+
+  // planes that the boxes on the way down have not been found inside of
+  constexpr uint32_t AllPlanes = (1u << 6) - 1;
+  std::array<std::pair<uint32_t, uint32_t>, MaxDepth> stack;
+  std::size_t size = 0;
+  stack[size++] = {0, AllPlanes};
+  while (size > 0) {
+    auto [index, planeMask] = stack[--size];
+    const TreeNode &node = m_tree[index];
+    if (!clipPlanes(frustum, node.box, planeMask)) {
+      continue;
+    }
+    if (planeMask == 0) {
+      addRange(node, result);
+    } else if (node.right == 0) {
+      addRange(node, m_candidateNodes);
+      m_candidateSpheres.insert(m_candidateSpheres.end(),
+                                m_spheres.begin() + node.first,
+                                m_spheres.begin() + node.first + node.count);
+    } else {
+      stack[size++] = {node.right, planeMask};
+      stack[size++] = {index + 1, planeMask};
+    }
+  }
+
+  m_candidateVisibility.resize(m_candidateSpheres.size());
+  cullSpheres(frustum, m_candidateSpheres, m_candidateVisibility.data());
+  for (std::size_t i = 0; i < m_candidateNodes.size(); ++i) {
+    if (m_candidateVisibility[i]) {
+      result.push_back(m_candidateNodes[i]);
+    }
+  }
+}
+
+void Bvh::query(const BoundingBox &box, std::vector<Node *> &result) const {
+  if (m_tree.empty()) {
+    return;
+  }
+  std::array<uint32_t, MaxDepth> stack;
+  std::size_t size = 0;
+  stack[size++] = 0;
+  while (size > 0) {
+    const TreeNode &node = m_tree[stack[--size]];
+    if (!overlaps(box, node.box)) {
+      continue;
+    }
+    if (contains(box, node.box)) {
+      addRange(node, result);
+    } else if (node.right == 0) {
+      for (uint32_t i = node.first; i < node.first + node.count; ++i) {
+        if (overlaps(box, m_items[i].box)) {
+          result.push_back(m_items[i].node);
+        }
+      }
+    } else {
+      uint32_t index = static_cast<uint32_t>(&node - m_tree.data());
+      stack[size++] = node.right;
+      stack[size++] = index + 1;
+    }
+  }
+}
+
+Bvh::RayHit Bvh::raycast(const glm::vec3 &origin, const glm::vec3 &direction,
+                         float maxDistance) const {
+  RayHit hit;
+  glm::vec3 inverseDirection(1.0f / direction.x, 1.0f / direction.y,
+                             1.0f / direction.z);
+  // boxes are visited near to far and skipped once they start beyond the
+  // closest hit so far, which limits the search from then on
+  float limit = maxDistance;
+  std::array<std::pair<uint32_t, float>, MaxDepth> stack;
+  std::size_t size = 0;
+  float distance;
+  if (!m_tree.empty() && intersectRay(m_tree[0].box, origin,
+                                      inverseDirection, limit, distance)) {
+    stack[size++] = {0, distance};
+  }
+  while (size > 0) {
+    auto [index, entry] = stack[--size];
+    if (entry > limit) {
+      continue;
+    }
+    const TreeNode &node = m_tree[index];
+    if (node.right == 0) {
+      for (uint32_t i = node.first; i < node.first + node.count; ++i) {
+        if (intersectRay(m_items[i].box, origin, inverseDirection, limit,
+                         distance) &&
+            (!hit.node || distance < hit.distance)) {
+          hit = {m_items[i].node, distance};
+          limit = distance;
+        }
+      }
+      continue;
+    }
+    std::pair<uint32_t, float> children[2];
+    std::size_t count = 0;
+    for (uint32_t child : {index + 1, node.right}) {
+      if (intersectRay(m_tree[child].box, origin, inverseDirection, limit,
+                       distance)) {
+        children[count++] = {child, distance};
+      }
+    }
+    // the nearer child is popped first
+    if (count == 2 && children[0].second < children[1].second) {
+      std::swap(children[0], children[1]);
+    }
+    for (std::size_t c = 0; c < count; ++c) {
+      stack[size++] = children[c];
+    }
+  }
+  return hit;
+}
@@ -0,0 +1,117 @@
+#ifndef __BVH_HPP__
+#define __BVH_HPP__
+
+#include "common.hpp"
+#include "frustum.hpp"
+#include "types.hpp"
+
+#include <cstdint>
+#include <limits>
+#include <span>
+#include <vector>
+
+class Mesh;
+class Node;
+class TransformStore;
+
+/**
+ * Bounding volume hierarchy over the world bounding boxes of nodes.
+ *
+ * build() splits the nodes top-down at the median of their centres along the
+ * longest axis until at most LEAF_SIZE remain. Every subtree covers a
+ * contiguous range of the nodes, so a subtree entirely inside a query volume
+ * is reported without visiting its children. The nodes of leaves that only
+ * partly overlap the view frustum are tested by their world bounding spheres
+ * together, with cullSpheres().
+ *
+ * Moving nodes does not change the shape of the tree. refit() recomputes the
+ * boxes of the nodes whose transforms changed and of their ancestors in the
+ * tree, in time proportional to the number of moved nodes. The tree gets
+ * looser as nodes move away from where it was built; build() restores it.
+ *
+ * Nodes are not owned and must outlive the tree or the next build().
+ */
+class Bvh {
+public:
+  static constexpr uint32_t LEAF_SIZE = 4;
+
+  struct RayHit {
+    Node *node = nullptr;
+    // distance along the ray, in units of its direction, to the point where
+    // it enters the box of node
+    float distance = std::numeric_limits<float>::infinity();
+  };
+
+  // index nodes, which must have a mesh and share a transform store
+  void build(std::span<Node *const> nodes);
+
+  // true if the tree was built from the same nodes, in the same order and
+  // with the same meshes
+  bool matches(std::span<Node *const> nodes) const;
+
+  // bring the boxes of the nodes moved by the last store.update() up to
+  // date; the whole tree is refitted if an update was missed
+  void refit(const TransformStore &store);
+
+  // append the nodes whose box intersects box
+  void query(const BoundingBox &box, std::vector<Node *> &result) const;
+  // append the nodes that intersect frustum; those in subtrees only partly
+  // inside of it are tested by their bounding spheres. Reuses scratch space
+  // of the tree, so calls must not overlap
+  void query(const Frustum &frustum, std::vector<Node *> &result) const;
+
+  // first node whose box the ray origin + t * direction enters for
+  // 0 <= t <= maxDistance; node is null if there is none
+  RayHit raycast(const glm::vec3 &origin, const glm::vec3 &direction,
+                 float maxDistance =
+                     std::numeric_limits<float>::infinity()) const;
+
+  std::size_t size() const { return m_items.size(); }
+  bool empty() const { return m_items.empty(); }
+
+private:
+  static constexpr uint32_t InvalidIndex = std::numeric_limits<uint32_t>::max();
+  // deeper than any tree of median splits over 32-bit indices
+  static constexpr std::size_t MaxDepth = 64;
+
+  struct TreeNode {
+    BoundingBox box;
+    // range of m_items covered by this subtree
+    uint32_t first = 0;
+    uint32_t count = 0;
+    // the left child directly follows its parent; 0 for leaves
+    uint32_t right = 0;
+    uint32_t parent = InvalidIndex;
+  };
+
+  struct Item {
+    Node *node;
+    BoundingBox box;
+    uint32_t leaf;
+  };
+
+  uint32_t buildRange(uint32_t first, uint32_t count, uint32_t parent);
+  // recompute the box of leaf and of its ancestors until one is unchanged
+  void refitPath(uint32_t leaf);
+  void refitAll();
+  void addRange(const TreeNode &node, std::vector<Node *> &result) const;
+
+  // parents precede their children
+  std::vector<TreeNode> m_tree;
+  std::vector<Item> m_items;
+  // world bounding spheres of m_items as (center, radius)
+  std::vector<glm::vec4> m_spheres;
+  // nodes, spheres and visibility that a frustum query tests one by one
+  mutable std::vector<Node *> m_candidateNodes;
+  mutable std::vector<glm::vec4> m_candidateSpheres;
+  mutable std::vector<uint8_t> m_candidateVisibility;
+  // nodes and meshes as given to build()
+  std::vector<Node *> m_nodes;
+  std::vector<const Mesh *> m_meshes;
+  // transform handle -> index in m_items
+  std::vector<uint32_t> m_itemOfHandle;
+  // TransformStore::updateCount() the boxes are up to date with
+  uint32_t m_updateCount = 0;
+};
+
+#endif
@@ -0,0 +1,71 @@
+#include "draw_groups.hpp"
+#include "mesh.hpp"
+#include "node.hpp"
+
+#include <limits>
+#include <unordered_map>
+
+void collectMeshNodes(std::span<const std::shared_ptr<Node>> roots,
+                      std::vector<Node *> &nodes) {
+  nodes.clear();
+  for (const auto &root : roots) {
+    // a root that has since been attached to another node is reached
+    // through its parent
+    if (!root->isRoot()) {
+      continue;
+    }
+    for (auto &node : root->depthFirst()) {
+      if (node.mesh()) {
+        nodes.push_back(&node);
+      }
+    }
+  }
+}
+
+void buildDrawGroups(std::span<Node *const> candidates,
+                     const std::function<uint32_t(const Node &)> &selectLod,
+                     std::vector<Node *> &nodes,
+                     std::vector<DrawGroup> &groups) {
+  // the group of each candidate
+  std::vector<uint32_t> groupOfNode;
+  groupOfNode.reserve(candidates.size());
+  // per mesh, the group of each level of detail
+  constexpr uint32_t NoGroup = std::numeric_limits<uint32_t>::max();
+  std::unordered_map<Mesh *, std::vector<uint32_t>> groupsOfMesh;
+  groups.clear();
+  for (Node *node : candidates) {
+    uint32_t lod = selectLod(*node);
+    auto &lodGroups = groupsOfMesh[node->mesh().get()];
+    if (lodGroups.empty()) {
+      lodGroups.resize(node->mesh()->numberOfLods(), NoGroup);
+    }
+    if (lodGroups[lod] == NoGroup) {
+      lodGroups[lod] = static_cast<uint32_t>(groups.size());
+      groups.push_back({node->mesh(), lod, 0, 0});
+    }
+    ++groups[lodGroups[lod]].instanceCount;
+    groupOfNode.push_back(lodGroups[lod]);
+  }
+
+  // place the nodes of each group consecutively
+  std::vector<uint32_t> next(groups.size());
+  uint32_t firstInstance = 0;
+  for (std::size_t g = 0; g < groups.size(); ++g) {
+    groups[g].firstInstance = firstInstance;
+    next[g] = firstInstance;
+    firstInstance += groups[g].instanceCount;
+  }
+  nodes.resize(candidates.size());
+  for (std::size_t i = 0; i < candidates.size(); ++i) {
+    nodes[next[groupOfNode[i]]++] = candidates[i];
+  }
+}
+
+void buildDrawGroups(std::span<const std::shared_ptr<Node>> roots,
+                     const std::function<uint32_t(const Node &)> &selectLod,
+                     std::vector<Node *> &nodes,
+                     std::vector<DrawGroup> &groups) {
+  std::vector<Node *> candidates;
+  collectMeshNodes(roots, candidates);
+  buildDrawGroups(candidates, selectLod, nodes, groups);
+}
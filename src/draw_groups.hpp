@@ -0,0 +1,45 @@
+#ifndef __DRAW_GROUPS_HPP__
+#define __DRAW_GROUPS_HPP__
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <span>
+#include <vector>
+
+class Mesh;
+class Node;
+
+// nodes sharing a mesh and its level of detail, drawn as instances
+// firstInstance to firstInstance + instanceCount - 1 of a single draw
+struct DrawGroup {
+  std::shared_ptr<Mesh> mesh;
+  uint32_t lod = 0;
+  uint32_t firstInstance = 0;
+  uint32_t instanceCount = 0;
+};
+
+// replace nodes with the nodes with a mesh below roots in depth-first order;
+// roots that have been given a parent are skipped
+void collectMeshNodes(std::span<const std::shared_ptr<Node>> roots,
+                      std::vector<Node *> &nodes);
+
+/**
+ * Group nodes with a mesh by mesh and level of detail.
+ *
+ * Groups are ordered by the first node in candidates that uses them. nodes
+ * receives the candidates ordered by group, so that the index of a node is
+ * its instance index. selectLod picks the level of detail of a node.
+ */
+void buildDrawGroups(std::span<Node *const> candidates,
+                     const std::function<uint32_t(const Node &)> &selectLod,
+                     std::vector<Node *> &nodes,
+                     std::vector<DrawGroup> &groups);
+
+// group every node with a mesh below roots, in depth-first order
+void buildDrawGroups(std::span<const std::shared_ptr<Node>> roots,
+                     const std::function<uint32_t(const Node &)> &selectLod,
+                     std::vector<Node *> &nodes,
+                     std::vector<DrawGroup> &groups);
+
+#endif
@@ -0,0 +1,1896 @@
+﻿#include "common.hpp"
+
+#include "engine.hpp"
+#include "frustum.hpp"
+#include "mesh.hpp"
+#include "node.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <ranges>
+
+void Engine::init_instance() {
+  LOGI("Initializing Vulkan instance.");
+
+  std::vector<const char *> required_instance_extensions;
+
+  // ヘッドレスモードではサーフェスを作らないので、拡張も不要
+  if (!headless) {
+    required_instance_extensions.push_back(VK_KHR_SURFACE_EXTENSION_NAME);
+    // required_instance_extensions.push_back(
+    //     VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME);
+
+    uint32_t sdlExtensionCount = 0;
+    auto sdlExtensions = SDL_Vulkan_GetInstanceExtensions(&sdlExtensionCount);
+    std::copy(sdlExtensions, sdlExtensions + sdlExtensionCount,
+              std::back_inserter(required_instance_extensions));
+  }
+
+  vkb::InstanceBuilder builder;
+  auto inst_ret =
+      builder.set_app_name("Simple Scene Graph V1.4 + Direct Rendering")
+          .set_engine_name("No Engine")
+          .set_headless(headless)
+          .enable_extensions(required_instance_extensions)
+          .require_api_version(VK_MAKE_VERSION(1, 4, 0))
+          .build();
+  if (!inst_ret) {
+    throw std::runtime_error("failed to create instance");
+  }
+  context.instance = inst_ret.value();
+
+  volkLoadInstance(context.instance);
+}
+
+void Engine::init_device() {
+  LOGI("Initializing Vulkan device.");
+
+  // VkPhysicalDeviceSynchronization2Features enable_sync2_features = {
+  //     .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SYNCHRONIZATION_2_FEATURES,
+  //     .synchronization2 = VK_TRUE};
+  // VkPhysicalDeviceExtendedDynamicStateFeaturesEXT
+  //     enable_extended_dynamic_state_features = {
+  //         .sType =
+  //             VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTENDED_DYNAMIC_STATE_FEATURES_EXT,
+  //         .pNext = &enable_sync2_features,
+  //         .extendedDynamicState = VK_TRUE};
+
+  VkPhysicalDeviceVulkan14Features features14 = {
+      .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_4_FEATURES,
+      .maintenance5 = VK_TRUE,
+      .maintenance6 = VK_TRUE,
+      .pushDescriptor = VK_TRUE,
+  };
+
+  VkPhysicalDeviceVulkan13Features features13 = {
+      .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES,
+      // .pNext = &enable_extended_dynamic_state_features,
+      .synchronization2 = VK_TRUE,
+      .dynamicRendering = VK_TRUE,
+  };
+
+  VkPhysicalDeviceVulkan12Features features12{
+      .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES,
+      // .pNext = &enable_extended_dynamic_state_features,
+      .descriptorIndexing = VK_TRUE,
+      .timelineSemaphore = VK_TRUE,
+      .bufferDeviceAddress = VK_TRUE,
+  };
+
+  // シーン全体を1回の間接描画で、ノードをインスタンスとして描くために必要
+  VkPhysicalDeviceFeatures features{
+      .multiDrawIndirect = VK_TRUE,
+      .drawIndirectFirstInstance = VK_TRUE,
+  };
+
+  vkb::PhysicalDeviceSelector selector{context.instance};
+  auto phys_ret = selector
+                      // .add_required_extensions({
+                          // VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME,
+                          // VK_EXT_EXTENDED_DYNAMIC_STATE_EXTENSION_NAME,
+                          // VK_KHR_SYNCHRONIZATION_2_EXTENSION_NAME,
+                      // })
+                      .set_minimum_version(1, 4)
+                      .set_required_features_14(features14)
+                      .set_required_features_13(features13)
+                      .set_required_features_12(features12)
+                      .set_required_features(features)
+                      .require_present(!headless)
+                      .set_surface(context.surface)
+                      .select();
+  if (!phys_ret) {
+    LOGE("failed to select Vulkan Physical Device");
+    throw std::runtime_error("failed to select Vulkan Physical Device");
+  }
+  context.physicalDevice = phys_ret.value();
+  context.maxDrawIndirectCount =
+      context.physicalDevice.properties.limits.maxDrawIndirectCount;
+
+  vkb::DeviceBuilder device_builder{phys_ret.value()};
+  auto dev_ret = device_builder.build();
+  if (!dev_ret) {
+    LOGE("Failed to create Vulkan device");
+    throw std::runtime_error("Failed to create Vulkan device");
+  }
+  context.device = dev_ret.value();
+
+  auto graphics_queue_ret = context.device.get_queue(vkb::QueueType::graphics);
+  if (!graphics_queue_ret) {
+    LOGE("Failed to get graphics queue");
+    return;
+  }
+  context.graphics_queue_index =
+      context.device.get_queue_index(vkb::QueueType::graphics).value();
+  context.queue = graphics_queue_ret.value();
+
+  // GPU時間はグラフィックスキューのタイムスタンプで計測する
+  uint32_t timestampValidBits =
+      context.device.queue_families[context.graphics_queue_index]
+          .timestampValidBits;
+  if (timestampValidBits > 0) {
+    context.timestampPeriod =
+        context.physicalDevice.properties.limits.timestampPeriod;
+    context.timestampMask = timestampValidBits >= 64
+                                ? std::numeric_limits<uint64_t>::max()
+                                : (uint64_t{1} << timestampValidBits) - 1;
+  } else {
+    LOGW("The graphics queue has no timestamps; GPU timings are disabled");
+  }
+
+  // 転送専用のキューがあれば、メッシュのアップロードは描画と別のキューで行う
+  auto transfer_queue_ret =
+      context.device.get_dedicated_queue(vkb::QueueType::transfer);
+  if (transfer_queue_ret) {
+    context.transfer_queue = transfer_queue_ret.value();
+    context.transfer_queue_index =
+        context.device.get_dedicated_queue_index(vkb::QueueType::transfer)
+            .value();
+    LOGI("Using dedicated transfer queue family {}",
+         context.transfer_queue_index);
+  } else {
+    context.transfer_queue = context.queue;
+    context.transfer_queue_index = context.graphics_queue_index;
+  }
+
+  VkCommandPoolCreateInfo cmd_pool_info{
+      .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+      .flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT,
+      .queueFamilyIndex = static_cast<uint32_t>(context.graphics_queue_index)};
+  VK_CHECK(vkCreateCommandPool(context.device, &cmd_pool_info, nullptr,
+                               &context.commandPool));
+
+  VmaVulkanFunctions functions{
+      .vkGetInstanceProcAddr = vkGetInstanceProcAddr,
+      .vkGetDeviceProcAddr = vkGetDeviceProcAddr,
+  };
+
+  VmaAllocatorCreateInfo createInfo{
+      .physicalDevice = context.physicalDevice,
+      .device = context.device,
+      .pVulkanFunctions = &functions,
+      .instance = context.instance,
+  };
+  VK_CHECK(vmaCreateAllocator(&createInfo, &context.vma_allocator));
+
+  context.uploader = std::make_unique<UploadBatcher>(
+      context.device, context.vma_allocator, context.transfer_queue,
+      static_cast<uint32_t>(context.transfer_queue_index),
+      static_cast<uint32_t>(context.graphics_queue_index),
+      UPLOAD_STAGING_SIZE);
+}
+
+/**
+ * Vertex Bufferの初期化
+ */
+void Engine::init_vertex_buffer() {
+  context.vertexBuffer.elementSize = sizeof(GpuVertex);
+  context.vertexBuffer.usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT;
+  grow_geometry(context.vertexBuffer, INITIAL_GEOMETRY_CAPACITY);
+
+  context.indexBuffer.elementSize = sizeof(uint32_t);
+  context.indexBuffer.usage = VK_BUFFER_USAGE_INDEX_BUFFER_BIT;
+  grow_geometry(context.indexBuffer, INITIAL_GEOMETRY_CAPACITY);
+
+  context.indexBuffer16.elementSize = sizeof(uint16_t);
+  context.indexBuffer16.usage = VK_BUFFER_USAGE_INDEX_BUFFER_BIT;
+  grow_geometry(context.indexBuffer16, INITIAL_GEOMETRY_CAPACITY);
+
+  for (const Node *node : meshNodes) {
+    if (!context.meshBufferMap.contains(node->mesh())) {
+      upload_mesh(node->mesh());
+    }
+  }
+  context.uploader->submit();
+}
+
+/**
+ * シーンに加わったメッシュをアップロードし、シーンから外れたメッシュを解放する
+ *
+ * 視錐台の外にあるだけのメッシュは解放しない。カメラの向きで解放と
+ * 再アップロードを繰り返し、共有バッファが断片化するのを避けるため。
+ */
+void Engine::update_meshes(PerFrame &per_frame) {
+  ++context.frameCount;
+  context.uploader->collect();
+  if (meshNodesChanged) {
+    meshNodesChanged = false;
+    for (const Node *node : meshNodes) {
+      auto it = context.meshBufferMap.find(node->mesh());
+      if (it != context.meshBufferMap.end()) {
+        it->second.lastUsedFrame = context.frameCount;
+      } else {
+        upload_mesh(node->mesh()).lastUsedFrame = context.frameCount;
+      }
+    }
+
+    // 以前のフレームがまだ参照している可能性があるので、範囲の解放は
+    // このフレームのqueue_submit_fenceがシグナルされた後で行う
+    std::erase_if(context.meshBufferMap, [&](const auto &entry) {
+      if (entry.second.lastUsedFrame == context.frameCount) {
+        return false;
+      }
+      per_frame.retiredMeshes.push_back(entry.second);
+      return true;
+    });
+  }
+
+  // 新しいメッシュのアップロードは待たずに送信し、描画はGPU側で待つ
+  context.uploader->submit();
+}
+
+/**
+ * メッシュを共有の頂点バッファとインデックスバッファにアップロードする
+ */
+MeshBuffer &Engine::upload_mesh(const std::shared_ptr<Mesh> &mesh) {
+  MeshBuffer meshBuffer{};
+  // 詳細度は全て同じインデックスの型を使う
+  meshBuffer.indexType = VK_INDEX_TYPE_UINT16;
+  for (std::size_t level = 0; level < mesh->numberOfLods(); ++level) {
+    if (!mesh->lod(level).hasShortIndices()) {
+      meshBuffer.indexType = VK_INDEX_TYPE_UINT32;
+    }
+  }
+  auto &indexBuffer = index_buffer(meshBuffer.indexType);
+
+  for (std::size_t level = 0; level < mesh->numberOfLods(); ++level) {
+    // 頂点バッファとインデックスバッファの形式に変換する
+    // 頂点数が65536以下なら16ビットに詰めて、メモリと帯域を半分にする
+    // 変換用の配列はステージングにコピーされた後で再利用する
+    GeometryUpload geometry = prepareGeometryUpload(
+        mesh->lod(level), meshBuffer.indexType == VK_INDEX_TYPE_UINT16,
+        encodedVertices, shortIndices);
+
+    MeshLodBuffer &lod = meshBuffer.lods.emplace_back();
+    lod.vertexCount = static_cast<uint32_t>(geometry.vertices.size());
+    lod.indexCount =
+        static_cast<uint32_t>(mesh->lod(level).numberOfIndices());
+    lod.vertexOffset = allocate_geometry(context.vertexBuffer, lod.vertexCount);
+    lod.firstIndex = allocate_geometry(indexBuffer, lod.indexCount);
+
+    // 転送はまとめて送信されるので、ここでは完了を待たない
+    context.uploader->copyToBuffer(
+        context.vertexBuffer.buffer.buffer,
+        lod.vertexOffset * context.vertexBuffer.elementSize,
+        geometry.vertices.data(), geometry.vertices.size_bytes());
+    context.uploader->copyToBuffer(
+        indexBuffer.buffer.buffer, lod.firstIndex * indexBuffer.elementSize,
+        geometry.indices.data(), geometry.indices.size_bytes());
+  }
+
+  return context.meshBufferMap[mesh] = std::move(meshBuffer);
+}
+
+/**
+ * 共有バッファからcount要素の範囲を確保する
+ *
+ * 空きが足りない場合はバッファを倍々で拡張する。
+ */
+uint32_t Engine::allocate_geometry(GeometryBuffer &geometry, uint32_t count) {
+  if (count == 0) {
+    return 0;
+  }
+  uint32_t offset = geometry.allocator.allocate(count);
+  if (offset != OffsetAllocator::InvalidOffset) {
+    return offset;
+  }
+
+  uint32_t oldCapacity = geometry.allocator.capacity();
+  uint32_t capacity = std::max(oldCapacity, INITIAL_GEOMETRY_CAPACITY);
+  while (capacity < oldCapacity + count) {
+    capacity *= 2;
+  }
+  grow_geometry(geometry, capacity);
+  return geometry.allocator.allocate(count);
+}
+
+/**
+ * 共有バッファを拡張し、既存の内容を新しいバッファにコピーする
+ */
+void Engine::grow_geometry(GeometryBuffer &geometry, uint32_t capacity) {
+  uint32_t oldCapacity = geometry.allocator.capacity();
+  LOGI("Growing geometry buffer from {} to {} elements", oldCapacity,
+       capacity);
+
+  auto buffer = createBuffer(capacity * geometry.elementSize,
+                             geometry.usage | VK_BUFFER_USAGE_TRANSFER_SRC_BIT |
+                                 VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                             VMA_MEMORY_USAGE_GPU_ONLY);
+  if (geometry.buffer.buffer != VK_NULL_HANDLE) {
+    // 古いバッファへの転送を完了させ、その所有権を取得してからコピーする。
+    // キューが空になるまで待つので、描画中のフレームが古いバッファを
+    // 参照していることもない
+    context.uploader->wait(context.uploader->submit());
+    auto acquires = context.uploader->acquireBarriers(
+        VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, VK_ACCESS_2_MEMORY_READ_BIT);
+
+    VkCommandBuffer commandBuffer = beginSingleTimeCommands();
+    if (!acquires.empty()) {
+      VkDependencyInfo dependencyInfo{
+          .sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO,
+          .bufferMemoryBarrierCount = static_cast<uint32_t>(acquires.size()),
+          .pBufferMemoryBarriers = acquires.data()};
+      vkCmdPipelineBarrier2(commandBuffer, &dependencyInfo);
+    }
+    VkBufferCopy copyRegion{};
+    copyRegion.size = oldCapacity * geometry.elementSize;
+    vkCmdCopyBuffer(commandBuffer, geometry.buffer.buffer, buffer.buffer, 1,
+                    &copyRegion);
+    endSingleTimeCommands(commandBuffer);
+
+    vmaDestroyBuffer(context.vma_allocator, geometry.buffer.buffer,
+                     geometry.buffer.allocation);
+  }
+  geometry.buffer = buffer;
+  geometry.allocator.grow(capacity);
+}
+
+/**
+ * Uniform Buffer Objectの初期化
+ */
+void Engine::init_ubo() {
+  // スワップチェーン (ヘッドレスモードではオフスクリーン) のイメージ毎
+  const uint32_t numberOfFrames =
+      static_cast<uint32_t>(context.per_frame.size());
+
+  // DescriptorPoolの作成
+  std::array<VkDescriptorPoolSize, 2> poolSizes{};
+  poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+  poolSizes[0].descriptorCount = numberOfFrames;
+  poolSizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+  poolSizes[1].descriptorCount = numberOfFrames;
+
+  VkDescriptorPoolCreateInfo poolInfo{};
+  poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+  poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+  poolInfo.pPoolSizes = poolSizes.data();
+  poolInfo.maxSets = numberOfFrames;
+
+  VK_CHECK(vkCreateDescriptorPool(context.device, &poolInfo, nullptr,
+                                  &context.descriptorPool));
+
+  // DescriptorSetLayoutの作成
+  // binding 0: カメラ (フレーム毎に1回更新)
+  VkDescriptorSetLayoutBinding cameraLayoutBinding{};
+  cameraLayoutBinding.binding = 0;
+  cameraLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+  cameraLayoutBinding.descriptorCount = 1;
+  cameraLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+  cameraLayoutBinding.pImmutableSamplers = nullptr;
+
+  // binding 1: ノード毎のモデル行列 (gl_InstanceIndexで参照する)
+  VkDescriptorSetLayoutBinding nodeLayoutBinding{};
+  nodeLayoutBinding.binding = 1;
+  nodeLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+  nodeLayoutBinding.descriptorCount = 1;
+  nodeLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+  nodeLayoutBinding.pImmutableSamplers = nullptr;
+
+  std::array<VkDescriptorSetLayoutBinding, 2> bindings = {cameraLayoutBinding,
+                                                          nodeLayoutBinding};
+  VkDescriptorSetLayoutCreateInfo layoutInfo{};
+  layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+  layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+  layoutInfo.pBindings = bindings.data();
+
+  VK_CHECK(vkCreateDescriptorSetLayout(context.device, &layoutInfo, nullptr,
+                                       &context.descriptorSetLayout));
+
+  // DescriptorSetsを作成する
+  std::vector<VkDescriptorSetLayout> layouts(numberOfFrames,
+                                             context.descriptorSetLayout);
+  VkDescriptorSetAllocateInfo allocInfo{};
+  allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+  allocInfo.descriptorPool = context.descriptorPool;
+  allocInfo.descriptorSetCount = static_cast<uint32_t>(layouts.size());
+  allocInfo.pSetLayouts = layouts.data();
+
+  std::vector<VkDescriptorSet> descriptorSets(numberOfFrames, VK_NULL_HANDLE);
+  VK_CHECK(vkAllocateDescriptorSets(context.device, &allocInfo,
+                                    descriptorSets.data()));
+
+  // フレーム毎のカメラ用Uniform Bufferとノード用Storage Bufferを作成する
+  std::size_t capacity = std::max(INITIAL_NUMBER_OF_NODES, nodes.size());
+  for (size_t i = 0; i < numberOfFrames; ++i) {
+    auto &per_frame = context.per_frame[i];
+    per_frame.descriptorSet = descriptorSets[i];
+
+    VkBufferCreateInfo bufferCreateInfo{};
+    bufferCreateInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    bufferCreateInfo.size = sizeof(CameraUniforms);
+    bufferCreateInfo.usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT;
+    bufferCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+    VmaAllocationCreateInfo allocationCreateInfo{};
+    allocationCreateInfo.flags =
+        VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT |
+        VMA_ALLOCATION_CREATE_MAPPED_BIT;
+    allocationCreateInfo.usage = VMA_MEMORY_USAGE_AUTO;
+
+    VmaAllocationInfo allocationInfo{};
+    VK_CHECK(vmaCreateBuffer(context.vma_allocator, &bufferCreateInfo,
+                             &allocationCreateInfo,
+                             &per_frame.cameraBuffer.buffer,
+                             &per_frame.cameraBuffer.allocation,
+                             &allocationInfo));
+    per_frame.cameraBufferMapped =
+        static_cast<CameraUniforms *>(allocationInfo.pMappedData);
+
+    VkDescriptorBufferInfo bufferInfo{};
+    bufferInfo.buffer = per_frame.cameraBuffer.buffer;
+    bufferInfo.offset = 0;
+    bufferInfo.range = sizeof(CameraUniforms);
+
+    VkWriteDescriptorSet descriptorWrite{};
+    descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    descriptorWrite.dstSet = per_frame.descriptorSet;
+    descriptorWrite.dstBinding = 0;
+    descriptorWrite.dstArrayElement = 0;
+    descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    descriptorWrite.descriptorCount = 1;
+    descriptorWrite.pBufferInfo = &bufferInfo;
+
+    vkUpdateDescriptorSets(context.device, 1, &descriptorWrite, 0, nullptr);
+
+    create_node_buffer(per_frame, capacity);
+  }
+}
+
+/**
+ * フレーム毎のノード用Storage Bufferと間接描画コマンド用のバッファを作成し、
+ * DescriptorSetを更新する
+ */
+void Engine::create_node_buffer(PerFrame &per_frame, std::size_t capacity) {
+  VkBufferCreateInfo bufferCreateInfo{};
+  bufferCreateInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+  bufferCreateInfo.size = capacity * sizeof(NodeUniforms);
+  bufferCreateInfo.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+  bufferCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+  VmaAllocationCreateInfo allocationCreateInfo{};
+  allocationCreateInfo.flags =
+      VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT |
+      VMA_ALLOCATION_CREATE_MAPPED_BIT;
+  allocationCreateInfo.usage = VMA_MEMORY_USAGE_AUTO;
+
+  VmaAllocationInfo allocationInfo{};
+  VK_CHECK(vmaCreateBuffer(context.vma_allocator, &bufferCreateInfo,
+                           &allocationCreateInfo, &per_frame.nodeBuffer.buffer,
+                           &per_frame.nodeBuffer.allocation, &allocationInfo));
+  per_frame.nodeBufferMapped =
+      static_cast<NodeUniforms *>(allocationInfo.pMappedData);
+  per_frame.nodeBufferCapacity = capacity;
+
+  // ノード毎に1つのVkDrawIndexedIndirectCommand
+  bufferCreateInfo.size = capacity * sizeof(VkDrawIndexedIndirectCommand);
+  bufferCreateInfo.usage = VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT;
+  VK_CHECK(vmaCreateBuffer(context.vma_allocator, &bufferCreateInfo,
+                           &allocationCreateInfo,
+                           &per_frame.drawCommandBuffer.buffer,
+                           &per_frame.drawCommandBuffer.allocation,
+                           &allocationInfo));
+  per_frame.drawCommandBufferMapped =
+      static_cast<VkDrawIndexedIndirectCommand *>(allocationInfo.pMappedData);
+
+  VkDescriptorBufferInfo bufferInfo{};
+  bufferInfo.buffer = per_frame.nodeBuffer.buffer;
+  bufferInfo.offset = 0;
+  bufferInfo.range = VK_WHOLE_SIZE;
+
+  std::array<VkWriteDescriptorSet, 1> descriptorWrites{};
+
+  descriptorWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+  descriptorWrites[0].dstSet = per_frame.descriptorSet;
+  descriptorWrites[0].dstBinding = 1;
+  descriptorWrites[0].dstArrayElement = 0;
+  descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+  descriptorWrites[0].descriptorCount = 1;
+  descriptorWrites[0].pBufferInfo = &bufferInfo;
+
+  vkUpdateDescriptorSets(context.device,
+                         static_cast<uint32_t>(descriptorWrites.size()),
+                         descriptorWrites.data(), 0, nullptr);
+}
+
+/**
+ * ノード用Storage Bufferと間接描画コマンド用のバッファの容量を確保する
+ *
+ * 容量が足りない場合は倍々で拡張する。古いバッファはこのフレームの
+ * queue_submit_fenceが次にシグナルされた後で破棄する。
+ */
+void Engine::reserve_node_buffer(PerFrame &per_frame,
+                                 std::size_t numberOfNodes) {
+  if (numberOfNodes <= per_frame.nodeBufferCapacity) {
+    return;
+  }
+  std::size_t capacity =
+      std::max(per_frame.nodeBufferCapacity, INITIAL_NUMBER_OF_NODES);
+  while (capacity < numberOfNodes) {
+    capacity *= 2;
+  }
+  LOGI("Growing node buffer from {} to {} nodes",
+       per_frame.nodeBufferCapacity, capacity);
+
+  if (per_frame.nodeBuffer.buffer != VK_NULL_HANDLE) {
+    per_frame.retiredBuffers.push_back(per_frame.nodeBuffer);
+  }
+  if (per_frame.drawCommandBuffer.buffer != VK_NULL_HANDLE) {
+    per_frame.retiredBuffers.push_back(per_frame.drawCommandBuffer);
+  }
+  create_node_buffer(per_frame, capacity);
+}
+
+/**
+ * 使用済みになったバッファの破棄
+ */
+void Engine::release_retired_buffers(PerFrame &per_frame) {
+  for (auto &retired : per_frame.retiredBuffers) {
+    vmaDestroyBuffer(context.vma_allocator, retired.buffer,
+                     retired.allocation);
+  }
+  per_frame.retiredBuffers.clear();
+
+  for (const auto &retired : per_frame.retiredMeshes) {
+    for (const auto &lod : retired.lods) {
+      if (lod.vertexCount > 0) {
+        context.vertexBuffer.allocator.free(lod.vertexOffset);
+      }
+      if (lod.indexCount > 0) {
+        index_buffer(retired.indexType).allocator.free(lod.firstIndex);
+      }
+    }
+  }
+  per_frame.retiredMeshes.clear();
+}
+
+/**
+ * カメラの行列
+ *
+ * 描画とカリングで同じ行列を使う。
+ */
+CameraUniforms Engine::camera_uniforms() const {
+  CameraUniforms camera{};
+  camera.view = glm::lookAt(eye, center, up);
+  // スワップチェーンとオフスクリーンのどちらでも描画先の大きさを使う
+  const auto &dimensions = context.swapchain_dimensions;
+  camera.proj = glm::perspective(
+      FIELD_OF_VIEW,                                            // fov
+      static_cast<float>(dimensions.width) / dimensions.height, // aspect ratio
+      NEAR_PLANE,                                               // near
+      FAR_PLANE                                                 // far
+  );
+  camera.proj[1][1] *= -1;
+  camera.viewProj = camera.proj * camera.view;
+  camera.light = light;
+  return camera;
+}
+
+/**
+ * UBOの更新
+ *
+ * カメラの行列はフレーム毎に1回だけ計算し、ノード毎にはモデル行列の
+ * 3x4部分だけを書き込む。合成はシェーダで行う。
+ */
+void Engine::update_ubo(PerFrame &per_frame) {
+  reserve_node_buffer(per_frame, nodes.size());
+  transforms->update(&jobs);
+
+  *per_frame.cameraBufferMapped = camera_uniforms();
+
+  // 永続的にマップされたバッファに各ノードのモデル行列を並列に書き込む
+  writeNodeUniforms(jobs, nodes, per_frame.nodeBufferMapped);
+
+  // メッシュ毎に1つの間接描画コマンドを書き込む。グループのノードは
+  // インスタンスとして描画され、シェーダはgl_InstanceIndexでモデル行列を
+  // 参照する。インデックスの型毎に描画するので、16ビットのものを先に並べる
+  uint32_t numberOfCommands = 0;
+  for (VkIndexType indexType : {VK_INDEX_TYPE_UINT16, VK_INDEX_TYPE_UINT32}) {
+    for (const auto &group : drawGroups) {
+      const auto &meshBuffer = context.meshBufferMap.at(group.mesh);
+      if (meshBuffer.indexType != indexType) {
+        continue;
+      }
+      const auto &lod = meshBuffer.lods[group.lod];
+      per_frame.drawCommandBufferMapped[numberOfCommands++] = {
+          .indexCount = lod.indexCount,
+          .instanceCount = group.instanceCount,
+          .firstIndex = lod.firstIndex,
+          .vertexOffset = static_cast<int32_t>(lod.vertexOffset),
+          .firstInstance = group.firstInstance};
+    }
+    if (indexType == VK_INDEX_TYPE_UINT16) {
+      shortIndexDrawCount = numberOfCommands;
+    }
+  }
+
+  // HOST_COHERENTでないメモリが選ばれた場合に備え、書き込んだ範囲を
+  // フレーム毎に1回だけフラッシュする (コヒーレントなら何もしない)
+  std::array<VmaAllocation, 3> allocations = {
+      per_frame.cameraBuffer.allocation, per_frame.nodeBuffer.allocation,
+      per_frame.drawCommandBuffer.allocation};
+  std::array<VkDeviceSize, 3> sizes = {
+      sizeof(CameraUniforms), nodes.size() * sizeof(NodeUniforms),
+      drawGroups.size() * sizeof(VkDrawIndexedIndirectCommand)};
+  VK_CHECK(vmaFlushAllocations(context.vma_allocator,
+                               static_cast<uint32_t>(allocations.size()),
+                               allocations.data(), nullptr, sizes.data()));
+}
+
+void Engine::init_per_frame(PerFrame &per_frame) {
+  VkFenceCreateInfo info{.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
+                         .flags = VK_FENCE_CREATE_SIGNALED_BIT};
+  VK_CHECK(vkCreateFence(context.device, &info, nullptr,
+                         &per_frame.queue_submit_fence));
+
+  VkCommandPoolCreateInfo cmd_pool_info{
+      .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+      .flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT,
+      .queueFamilyIndex = static_cast<uint32_t>(context.graphics_queue_index)};
+  VK_CHECK(vkCreateCommandPool(context.device, &cmd_pool_info, nullptr,
+                               &per_frame.primary_command_pool));
+
+  VkCommandBufferAllocateInfo cmd_buf_info{
+      .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+      .commandPool = per_frame.primary_command_pool,
+      .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+      .commandBufferCount = 1};
+  VK_CHECK(vkAllocateCommandBuffers(context.device, &cmd_buf_info,
+                                    &per_frame.primary_command_buffer));
+
+  if (context.timestampMask != 0) {
+    VkQueryPoolCreateInfo query_pool_info{
+        .sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+        .queryType = VK_QUERY_TYPE_TIMESTAMP,
+        .queryCount = 2};
+    VK_CHECK(vkCreateQueryPool(context.device, &query_pool_info, nullptr,
+                               &per_frame.timestampQueryPool));
+  }
+}
+
+void Engine::teardown_per_frame(PerFrame &per_frame) {
+  if (per_frame.queue_submit_fence != VK_NULL_HANDLE) {
+    vkDestroyFence(context.device, per_frame.queue_submit_fence, nullptr);
+
+    per_frame.queue_submit_fence = VK_NULL_HANDLE;
+  }
+
+  if (per_frame.primary_command_buffer != VK_NULL_HANDLE) {
+    vkFreeCommandBuffers(context.device, per_frame.primary_command_pool, 1,
+                         &per_frame.primary_command_buffer);
+
+    per_frame.primary_command_buffer = VK_NULL_HANDLE;
+  }
+
+  if (per_frame.primary_command_pool != VK_NULL_HANDLE) {
+    vkDestroyCommandPool(context.device, per_frame.primary_command_pool,
+                         nullptr);
+
+    per_frame.primary_command_pool = VK_NULL_HANDLE;
+  }
+
+  if (per_frame.timestampQueryPool != VK_NULL_HANDLE) {
+    vkDestroyQueryPool(context.device, per_frame.timestampQueryPool, nullptr);
+
+    per_frame.timestampQueryPool = VK_NULL_HANDLE;
+    per_frame.timestampsPending = false;
+  }
+
+  if (per_frame.swapchain_acquire_semaphore != VK_NULL_HANDLE) {
+    vkDestroySemaphore(context.device, per_frame.swapchain_acquire_semaphore,
+                       nullptr);
+
+    per_frame.swapchain_acquire_semaphore = VK_NULL_HANDLE;
+  }
+
+  if (per_frame.swapchain_release_semaphore != VK_NULL_HANDLE) {
+    vkDestroySemaphore(context.device, per_frame.swapchain_release_semaphore,
+                       nullptr);
+
+    per_frame.swapchain_release_semaphore = VK_NULL_HANDLE;
+  }
+
+  if (per_frame.cameraBuffer.buffer != VK_NULL_HANDLE) {
+    vmaDestroyBuffer(context.vma_allocator, per_frame.cameraBuffer.buffer,
+                     per_frame.cameraBuffer.allocation);
+    per_frame.cameraBuffer = {};
+    per_frame.cameraBufferMapped = nullptr;
+  }
+
+  if (per_frame.nodeBuffer.buffer != VK_NULL_HANDLE) {
+    vmaDestroyBuffer(context.vma_allocator, per_frame.nodeBuffer.buffer,
+                     per_frame.nodeBuffer.allocation);
+    per_frame.nodeBuffer = {};
+    per_frame.nodeBufferMapped = nullptr;
+    per_frame.nodeBufferCapacity = 0;
+  }
+
+  if (per_frame.drawCommandBuffer.buffer != VK_NULL_HANDLE) {
+    vmaDestroyBuffer(context.vma_allocator, per_frame.drawCommandBuffer.buffer,
+                     per_frame.drawCommandBuffer.allocation);
+    per_frame.drawCommandBuffer = {};
+    per_frame.drawCommandBufferMapped = nullptr;
+  }
+
+  release_retired_buffers(per_frame);
+}
+
+void Engine::init_swapchain() {
+  vkb::SwapchainBuilder swapchain_builder{context.device};
+  auto swap_ret =
+      swapchain_builder.set_old_swapchain(context.swapchain).build();
+  if (!swap_ret) {
+    LOGE("failed to create swapchain");
+    return;
+  }
+  vkb::destroy_swapchain(context.swapchain);
+  context.swapchain = swap_ret.value();
+  uint32_t image_count = context.swapchain.image_count;
+
+  context.swapchain_dimensions = {context.swapchain.extent.width,
+                                  context.swapchain.extent.height,
+                                  context.swapchain.image_format};
+
+  context.swapchain_images = context.swapchain.get_images().value();
+
+  context.per_frame.clear();
+  context.per_frame.resize(image_count);
+  for (size_t i = 0; i < image_count; i++) {
+    init_per_frame(context.per_frame[i]);
+  }
+
+  context.swapchain_image_views = context.swapchain.get_image_views().value();
+}
+
+/**
+ * ヘッドレスモードで、スワップチェーンの代わりに描画するイメージを作成する
+ */
+void Engine::init_offscreen() {
+  context.swapchain_dimensions = {windowWidth, windowHeight, HEADLESS_FORMAT};
+
+  context.per_frame.clear();
+  context.per_frame.resize(HEADLESS_IMAGE_COUNT);
+  for (auto &per_frame : context.per_frame) {
+    init_per_frame(per_frame);
+
+    // 描画後に読み出せるように、転送元としても使う
+    VkImageCreateInfo imageInfo{};
+    imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    imageInfo.imageType = VK_IMAGE_TYPE_2D;
+    imageInfo.extent = {context.swapchain_dimensions.width,
+                        context.swapchain_dimensions.height, 1};
+    imageInfo.mipLevels = 1;
+    imageInfo.arrayLayers = 1;
+    imageInfo.format = context.swapchain_dimensions.format;
+    imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+    imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    imageInfo.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT |
+                      VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+    imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+    imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+    VmaAllocationCreateInfo allocCreateInfo{};
+    allocCreateInfo.usage = VMA_MEMORY_USAGE_GPU_ONLY;
+    allocCreateInfo.requiredFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+
+    VkImage image = VK_NULL_HANDLE;
+    VmaAllocation allocation = VK_NULL_HANDLE;
+    VK_CHECK(vmaCreateImage(context.vma_allocator, &imageInfo,
+                            &allocCreateInfo, &image, &allocation, nullptr));
+    context.swapchain_images.push_back(image);
+    context.offscreen_allocations.push_back(allocation);
+
+    VkImageViewCreateInfo viewInfo{};
+    viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    viewInfo.image = image;
+    viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+    viewInfo.format = context.swapchain_dimensions.format;
+    viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    viewInfo.subresourceRange.baseMipLevel = 0;
+    viewInfo.subresourceRange.levelCount = 1;
+    viewInfo.subresourceRange.baseArrayLayer = 0;
+    viewInfo.subresourceRange.layerCount = 1;
+
+    VkImageView imageView = VK_NULL_HANDLE;
+    VK_CHECK(vkCreateImageView(context.device, &viewInfo, nullptr, &imageView));
+    context.swapchain_image_views.push_back(imageView);
+  }
+}
+
+static std::vector<char> readFile(const std::string &filename) {
+  std::ifstream file(filename, std::ios::ate | std::ios::binary);
+
+  if (!file.is_open()) {
+    throw std::runtime_error("failed to open file!");
+  }
+
+  size_t fileSize = (size_t)file.tellg();
+  std::vector<char> buffer(fileSize);
+
+  file.seekg(0);
+  file.read(buffer.data(), fileSize);
+
+  file.close();
+
+  return buffer;
+}
+
+VkShaderModule Engine::load_shader_module(const char *path) {
+  std::vector<char> spirv = readFile(path);
+  VkShaderModuleCreateInfo module_info{
+      .sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
+      .codeSize = spirv.size(),
+      .pCode = reinterpret_cast<const uint32_t *>(spirv.data())};
+
+  VkShaderModule shader_module;
+  VK_CHECK(vkCreateShaderModule(context.device, &module_info, nullptr,
+                                &shader_module));
+
+  return shader_module;
+}
+
+void Engine::init_pipeline() {
+  VkPipelineLayoutCreateInfo layout_info{
+      VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO};
+  layout_info.setLayoutCount = 1;
+  layout_info.pSetLayouts = &context.descriptorSetLayout;
+  VK_CHECK(vkCreatePipelineLayout(context.device, &layout_info, nullptr,
+                                  &context.pipeline_layout));
+
+  VkVertexInputBindingDescription binding_description{
+      .binding = 0,
+      .stride = sizeof(GpuVertex),
+      .inputRate = VK_VERTEX_INPUT_RATE_VERTEX};
+
+  // 頂点の形式はビルド時に選択される (vertex_format.hpp)
+  const auto &attribute_descriptions = ActiveVertexTraits::attributes;
+
+  VkPipelineVertexInputStateCreateInfo vertex_input{
+      .sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO,
+      .vertexBindingDescriptionCount = 1,
+      .pVertexBindingDescriptions = &binding_description,
+      .vertexAttributeDescriptionCount =
+          static_cast<uint32_t>(attribute_descriptions.size()),
+      .pVertexAttributeDescriptions = attribute_descriptions.data()};
+
+  VkPipelineInputAssemblyStateCreateInfo input_assembly{
+      .sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO,
+      .topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST,
+      .primitiveRestartEnable = VK_FALSE};
+
+  VkPipelineRasterizationStateCreateInfo raster{
+      .sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO,
+      .depthClampEnable = VK_FALSE,
+      .rasterizerDiscardEnable = VK_FALSE,
+      .polygonMode = VK_POLYGON_MODE_FILL,
+      .depthBiasEnable = VK_FALSE,
+      .lineWidth = 1.0f};
+
+  std::vector<VkDynamicState> dynamic_states = {
+      VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR,
+      VK_DYNAMIC_STATE_CULL_MODE, VK_DYNAMIC_STATE_FRONT_FACE,
+      VK_DYNAMIC_STATE_PRIMITIVE_TOPOLOGY};
+
+  VkPipelineColorBlendAttachmentState blend_attachment{
+      .colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT |
+                        VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT};
+
+  VkPipelineColorBlendStateCreateInfo blend{
+      .sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO,
+      .attachmentCount = 1,
+      .pAttachments = &blend_attachment};
+
+  VkPipelineViewportStateCreateInfo viewport{
+      .sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO,
+      .viewportCount = 1,
+      .scissorCount = 1};
+
+  VkPipelineDepthStencilStateCreateInfo depth_stencil{
+      .sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO,
+      .depthTestEnable = VK_TRUE,
+      .depthWriteEnable = VK_TRUE,
+      .depthCompareOp = VK_COMPARE_OP_LESS,
+      .depthBoundsTestEnable = VK_FALSE,
+      .stencilTestEnable = VK_FALSE,
+      .minDepthBounds = 0.0f,
+      .maxDepthBounds = 1.0f,
+  };
+
+  VkPipelineMultisampleStateCreateInfo multisample{
+      .sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO,
+      .rasterizationSamples = VK_SAMPLE_COUNT_1_BIT};
+
+  VkPipelineDynamicStateCreateInfo dynamic_state_info{
+      .sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO,
+      .dynamicStateCount = static_cast<uint32_t>(dynamic_states.size()),
+      .pDynamicStates = dynamic_states.data()};
+
+  std::array<VkPipelineShaderStageCreateInfo, 2> shader_stages = {
+      {{.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+        .stage = VK_SHADER_STAGE_VERTEX_BIT,
+        .module = load_shader_module("shaders/triangle.vert.spv"),
+        .pName = "main"},
+       {.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+        .stage = VK_SHADER_STAGE_FRAGMENT_BIT,
+        .module = load_shader_module("shaders/triangle.frag.spv"),
+        .pName = "main"}}};
+
+  VkPipelineRenderingCreateInfo pipeline_rendering_info{
+      .sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO,
+      .colorAttachmentCount = 1,
+      .pColorAttachmentFormats = &context.swapchain_dimensions.format,
+      .depthAttachmentFormat = context.depthFormat};
+
+  VkGraphicsPipelineCreateInfo pipe{
+      .sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO,
+      .pNext = &pipeline_rendering_info,
+      .stageCount = static_cast<uint32_t>(shader_stages.size()),
+      .pStages = shader_stages.data(),
+      .pVertexInputState = &vertex_input,
+      .pInputAssemblyState = &input_assembly,
+      .pViewportState = &viewport,
+      .pRasterizationState = &raster,
+      .pMultisampleState = &multisample,
+      .pDepthStencilState = &depth_stencil,
+      .pColorBlendState = &blend,
+      .pDynamicState = &dynamic_state_info,
+      .layout = context.pipeline_layout,
+      .renderPass = VK_NULL_HANDLE,
+      .subpass = 0,
+  };
+
+  VK_CHECK(vkCreateGraphicsPipelines(context.device, VK_NULL_HANDLE, 1, &pipe,
+                                     nullptr, &context.pipeline));
+
+  vkDestroyShaderModule(context.device, shader_stages[0].module, nullptr);
+  vkDestroyShaderModule(context.device, shader_stages[1].module, nullptr);
+}
+
+/**
+ * 完了したフレームの描画パスのGPU時間を記録する
+ *
+ * GPUの時刻はCPUの時刻と対応付けられないので、トレースでは提出した時刻から
+ * 始まるものとして扱う。
+ */
+void Engine::read_timestamps(PerFrame &per_frame) {
+  if (!per_frame.timestampsPending) {
+    return;
+  }
+  per_frame.timestampsPending = false;
+
+  std::array<uint64_t, 2> timestamps{};
+  VkResult res = vkGetQueryPoolResults(
+      context.device, per_frame.timestampQueryPool, 0, 2, sizeof(timestamps),
+      timestamps.data(), sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+  if (res != VK_SUCCESS) {
+    return;
+  }
+  uint64_t ticks = (timestamps[1] - timestamps[0]) & context.timestampMask;
+  timings.record("render pass", Profiler::Track::Gpu, per_frame.submitTime,
+                 ticks * context.timestampPeriod * 1e-6);
+}
+
+void Engine::wait_for_frame(PerFrame &per_frame) {
+  if (per_frame.queue_submit_fence != VK_NULL_HANDLE) {
+    vkWaitForFences(context.device, 1, &per_frame.queue_submit_fence, true,
+                    UINT64_MAX);
+    vkResetFences(context.device, 1, &per_frame.queue_submit_fence);
+  }
+
+  read_timestamps(per_frame);
+
+  release_retired_buffers(per_frame);
+
+  if (per_frame.primary_command_pool != VK_NULL_HANDLE) {
+    vkResetCommandPool(context.device, per_frame.primary_command_pool, 0);
+  }
+}
+
+VkResult Engine::acquire_next_swapchain_image(uint32_t *image) {
+  if (headless) {
+    // オフスクリーンのイメージは順番に使う
+    *image = static_cast<uint32_t>((context.currentIndex + 1) %
+                                   context.per_frame.size());
+    wait_for_frame(context.per_frame[*image]);
+    return VK_SUCCESS;
+  }
+
+  VkSemaphore acquire_semaphore;
+  if (context.recycled_semaphores.empty()) {
+    VkSemaphoreCreateInfo info = {VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO};
+    VK_CHECK(
+        vkCreateSemaphore(context.device, &info, nullptr, &acquire_semaphore));
+  } else {
+    acquire_semaphore = context.recycled_semaphores.back();
+    context.recycled_semaphores.pop_back();
+  }
+
+  VkResult res =
+      vkAcquireNextImageKHR(context.device, context.swapchain, UINT64_MAX,
+                            acquire_semaphore, VK_NULL_HANDLE, image);
+
+  if (res != VK_SUCCESS) {
+    context.recycled_semaphores.push_back(acquire_semaphore);
+    return res;
+  }
+
+  wait_for_frame(context.per_frame[*image]);
+
+  VkSemaphore old_semaphore =
+      context.per_frame[*image].swapchain_acquire_semaphore;
+
+  if (old_semaphore != VK_NULL_HANDLE) {
+    context.recycled_semaphores.push_back(old_semaphore);
+  }
+
+  context.per_frame[*image].swapchain_acquire_semaphore = acquire_semaphore;
+
+  return VK_SUCCESS;
+}
+
+void Engine::render(uint32_t swapchain_index) {
+  auto recording = timings.scope("record");
+  VkCommandBuffer cmd =
+      context.per_frame[swapchain_index].primary_command_buffer;
+  VkQueryPool timestampQueryPool =
+      context.per_frame[swapchain_index].timestampQueryPool;
+
+  VkCommandBufferBeginInfo begin_info{
+      .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+      .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT};
+
+  VK_CHECK(vkBeginCommandBuffer(cmd, &begin_info));
+
+  if (timestampQueryPool != VK_NULL_HANDLE) {
+    vkCmdResetQueryPool(cmd, timestampQueryPool, 0, 2);
+  }
+
+  transitionImageLayout(cmd, context.swapchain_images[swapchain_index],
+                        VK_IMAGE_LAYOUT_UNDEFINED,
+                        VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, 0,
+                        VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT,
+                        VK_PIPELINE_STAGE_2_TOP_OF_PIPE_BIT,
+                        VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT);
+  VkClearValue clear_value{.color = {{0.01f, 0.01f, 0.033f, 1.0f}}};
+
+  VkRenderingAttachmentInfo color_attachment{
+      .sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO,
+      .imageView = context.swapchain_image_views[swapchain_index],
+      .imageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+      .loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR,
+      .storeOp = VK_ATTACHMENT_STORE_OP_STORE,
+      .clearValue = clear_value};
+
+  VkClearValue depthClearValue = {{1.0f, 0.0f}};
+  VkRenderingAttachmentInfo depth_attachment{
+      .sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO,
+      .imageView = context.depthImageView,
+      .imageLayout = VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL,
+      .loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR,
+      .storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
+      .clearValue = depthClearValue};
+
+  VkRenderingInfo rendering_info{
+      .sType = VK_STRUCTURE_TYPE_RENDERING_INFO_KHR,
+      .renderArea = {.offset = {0, 0},
+                     .extent = {.width = context.swapchain_dimensions.width,
+                                .height = context.swapchain_dimensions.height}},
+      .layerCount = 1,
+      .colorAttachmentCount = 1,
+      .pColorAttachments = &color_attachment,
+      .pDepthAttachment = &depth_attachment};
+
+  // 転送キューで書き込まれたメッシュデータの所有権を取得する
+  auto acquires = context.uploader->acquireBarriers(
+      VK_PIPELINE_STAGE_2_VERTEX_ATTRIBUTE_INPUT_BIT |
+          VK_PIPELINE_STAGE_2_INDEX_INPUT_BIT,
+      VK_ACCESS_2_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_2_INDEX_READ_BIT);
+  if (!acquires.empty()) {
+    VkDependencyInfo dependency_info{
+        .sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO,
+        .bufferMemoryBarrierCount = static_cast<uint32_t>(acquires.size()),
+        .pBufferMemoryBarriers = acquires.data()};
+    vkCmdPipelineBarrier2(cmd, &dependency_info);
+  }
+
+  // 描画パスのGPU時間を計測する
+  if (timestampQueryPool != VK_NULL_HANDLE) {
+    vkCmdWriteTimestamp2(cmd, VK_PIPELINE_STAGE_2_TOP_OF_PIPE_BIT,
+                         timestampQueryPool, 0);
+  }
+
+  vkCmdBeginRendering(cmd, &rendering_info);
+
+  vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, context.pipeline);
+
+  VkViewport vp{.width = static_cast<float>(context.swapchain_dimensions.width),
+                .height =
+                    static_cast<float>(context.swapchain_dimensions.height),
+                .minDepth = 0.0f,
+                .maxDepth = 1.0f};
+
+  vkCmdSetViewport(cmd, 0, 1, &vp);
+
+  VkRect2D scissor{.extent = {.width = context.swapchain_dimensions.width,
+                              .height = context.swapchain_dimensions.height}};
+
+  vkCmdSetScissor(cmd, 0, 1, &scissor);
+
+  vkCmdSetCullMode(cmd, VK_CULL_MODE_NONE);
+
+  vkCmdSetFrontFace(cmd, VK_FRONT_FACE_CLOCKWISE);
+
+  vkCmdSetPrimitiveTopology(cmd, VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST);
+
+  vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                          context.pipeline_layout, 0, 1,
+                          &context.per_frame[swapchain_index].descriptorSet,
+                          0, nullptr);
+
+  // 全てのメッシュは共有の頂点バッファとインデックスバッファにあるので、
+  // インデックスの型毎にバインドは1回だけで、それぞれ1回の間接描画で描く
+  VkDeviceSize offset = {0};
+  vkCmdBindVertexBuffers(cmd, 0, 1, &context.vertexBuffer.buffer.buffer,
+                         &offset);
+
+  VkBuffer drawCommandBuffer =
+      context.per_frame[swapchain_index].drawCommandBuffer.buffer;
+  uint32_t numberOfDraws = static_cast<uint32_t>(drawGroups.size());
+  auto drawIndexed = [&](VkIndexType indexType, uint32_t begin,
+                         uint32_t end) {
+    if (begin == end) {
+      return;
+    }
+    vkCmdBindIndexBuffer(cmd, index_buffer(indexType).buffer.buffer, 0,
+                         indexType);
+    for (uint32_t first = begin; first < end;) {
+      uint32_t drawCount = std::min(end - first, context.maxDrawIndirectCount);
+      vkCmdDrawIndexedIndirect(cmd, drawCommandBuffer,
+                               first * sizeof(VkDrawIndexedIndirectCommand),
+                               drawCount,
+                               sizeof(VkDrawIndexedIndirectCommand));
+      first += drawCount;
+    }
+  };
+  drawIndexed(VK_INDEX_TYPE_UINT16, 0, shortIndexDrawCount);
+  drawIndexed(VK_INDEX_TYPE_UINT32, shortIndexDrawCount, numberOfDraws);
+
+  vkCmdEndRendering(cmd);
+
+  if (timestampQueryPool != VK_NULL_HANDLE) {
+    vkCmdWriteTimestamp2(cmd, VK_PIPELINE_STAGE_2_BOTTOM_OF_PIPE_BIT,
+                         timestampQueryPool, 1);
+  }
+
+  if (headless) {
+    // readPixels()で読み出せるように、転送元のレイアウトにしておく
+    transitionImageLayout(
+        cmd, context.swapchain_images[swapchain_index],
+        VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+        VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+        VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT,          // srcAccessMask
+        VK_ACCESS_2_TRANSFER_READ_BIT,                   // dstAccessMask
+        VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT, // srcStage
+        VK_PIPELINE_STAGE_2_COPY_BIT                     // dstStage
+    );
+  } else {
+    transitionImageLayout(
+        cmd, context.swapchain_images[swapchain_index],
+        VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+        VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
+        VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT,          // srcAccessMask
+        0,                                               // dstAccessMask
+        VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT, // srcStage
+        VK_PIPELINE_STAGE_2_BOTTOM_OF_PIPE_BIT           // dstStage
+    );
+  }
+
+  VK_CHECK(vkEndCommandBuffer(cmd));
+  recording.end();
+
+  auto submitting = timings.scope("submit");
+  if (!headless &&
+      context.per_frame[swapchain_index].swapchain_release_semaphore ==
+          VK_NULL_HANDLE) {
+    VkSemaphoreCreateInfo semaphore_info{
+        VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO};
+    VK_CHECK(vkCreateSemaphore(
+        context.device, &semaphore_info, nullptr,
+        &context.per_frame[swapchain_index].swapchain_release_semaphore));
+  }
+
+  // スワップチェーンのイメージの取得と、メッシュのアップロードの完了を待つ
+  // ヘッドレスモードではスワップチェーンのセマフォを使わない
+  const uint32_t first_wait = headless ? 1 : 0;
+  std::array<VkSemaphore, 2> wait_semaphores = {
+      context.per_frame[swapchain_index].swapchain_acquire_semaphore,
+      context.uploader->semaphore()};
+  std::array<VkPipelineStageFlags, 2> wait_stages = {
+      VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT};
+  std::array<uint64_t, 2> wait_values = {0,
+                                         context.uploader->submittedValue()};
+  VkTimelineSemaphoreSubmitInfo timeline_info{
+      .sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO,
+      .waitSemaphoreValueCount =
+          static_cast<uint32_t>(wait_values.size()) - first_wait,
+      .pWaitSemaphoreValues = wait_values.data() + first_wait};
+
+  VkSubmitInfo info{
+      .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+      .pNext = &timeline_info,
+      .waitSemaphoreCount =
+          static_cast<uint32_t>(wait_semaphores.size()) - first_wait,
+      .pWaitSemaphores = wait_semaphores.data() + first_wait,
+      .pWaitDstStageMask = wait_stages.data() + first_wait,
+      .commandBufferCount = 1,
+      .pCommandBuffers = &cmd,
+      .signalSemaphoreCount = headless ? 0u : 1u,
+      .pSignalSemaphores =
+          &context.per_frame[swapchain_index].swapchain_release_semaphore};
+
+  VK_CHECK(
+      vkQueueSubmit(context.queue, 1, &info,
+                    context.per_frame[swapchain_index].queue_submit_fence));
+
+  context.per_frame[swapchain_index].timestampsPending =
+      timestampQueryPool != VK_NULL_HANDLE;
+  context.per_frame[swapchain_index].submitTime = Profiler::Clock::now();
+}
+
+VkResult Engine::present_image(uint32_t index) {
+  VkSwapchainKHR swapChains[] = {context.swapchain};
+  VkPresentInfoKHR present{
+      .sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR,
+      .waitSemaphoreCount = 1,
+      .pWaitSemaphores = &context.per_frame[index].swapchain_release_semaphore,
+      .swapchainCount = 1,
+      .pSwapchains = swapChains,
+      .pImageIndices = &index,
+  };
+  return vkQueuePresentKHR(context.queue, &present);
+}
+
+/**
+ * ヘッドレスモードで最後に描画したイメージを読み出す
+ */
+std::vector<uint8_t> Engine::readPixels() {
+  if (!headless) {
+    throw std::runtime_error("readPixels() requires headless mode");
+  }
+  if (context.currentIndex >= context.per_frame.size()) {
+    throw std::runtime_error("no frame has been rendered");
+  }
+
+  const auto &dimensions = context.swapchain_dimensions;
+  VkDeviceSize size =
+      static_cast<VkDeviceSize>(dimensions.width) * dimensions.height * 4;
+
+  VkBufferCreateInfo bufferInfo{};
+  bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+  bufferInfo.size = size;
+  bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+  bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+  VmaAllocationCreateInfo allocationCreateInfo{};
+  allocationCreateInfo.flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT |
+                               VMA_ALLOCATION_CREATE_MAPPED_BIT;
+  allocationCreateInfo.usage = VMA_MEMORY_USAGE_AUTO;
+
+  AllocatedBuffer readback;
+  VmaAllocationInfo allocationInfo{};
+  VK_CHECK(vmaCreateBuffer(context.vma_allocator, &bufferInfo,
+                           &allocationCreateInfo, &readback.buffer,
+                           &readback.allocation, &allocationInfo));
+
+  // render()の最後のバリアで、描画の完了後にコピーされる
+  VkCommandBuffer cmd = beginSingleTimeCommands();
+  VkBufferImageCopy region{
+      .imageSubresource = {.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+                           .mipLevel = 0,
+                           .baseArrayLayer = 0,
+                           .layerCount = 1},
+      .imageExtent = {dimensions.width, dimensions.height, 1}};
+  vkCmdCopyImageToBuffer(cmd, context.swapchain_images[context.currentIndex],
+                         VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, readback.buffer,
+                         1, &region);
+  VkMemoryBarrier2 host_barrier{.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2,
+                                .srcStageMask = VK_PIPELINE_STAGE_2_COPY_BIT,
+                                .srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT,
+                                .dstStageMask = VK_PIPELINE_STAGE_2_HOST_BIT,
+                                .dstAccessMask = VK_ACCESS_2_HOST_READ_BIT};
+  VkDependencyInfo dependency_info{.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO,
+                                   .memoryBarrierCount = 1,
+                                   .pMemoryBarriers = &host_barrier};
+  vkCmdPipelineBarrier2(cmd, &dependency_info);
+  endSingleTimeCommands(cmd);
+
+  VK_CHECK(vmaInvalidateAllocation(context.vma_allocator, readback.allocation,
+                                   0, VK_WHOLE_SIZE));
+  std::vector<uint8_t> pixels(size);
+  std::memcpy(pixels.data(), allocationInfo.pMappedData, size);
+
+  vmaDestroyBuffer(context.vma_allocator, readback.buffer,
+                   readback.allocation);
+  return pixels;
+}
+
+void Engine::transitionImageLayout(VkCommandBuffer cmd, VkImage image,
+                                   VkImageLayout oldLayout,
+                                   VkImageLayout newLayout,
+                                   VkAccessFlags2 srcAccessMask,
+                                   VkAccessFlags2 dstAccessMask,
+                                   VkPipelineStageFlags2 srcStage,
+                                   VkPipelineStageFlags2 dstStage) {
+  VkImageMemoryBarrier2 image_barrier{
+      .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2,
+      .srcStageMask = srcStage,
+      .srcAccessMask = srcAccessMask,
+      .dstStageMask = dstStage,
+      .dstAccessMask = dstAccessMask,
+
+      .oldLayout = oldLayout,
+      .newLayout = newLayout,
+
+      .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+      .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+
+      .image = image,
+
+      .subresourceRange = {.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+                           .levelCount = 1,
+                           .baseArrayLayer = 0,
+                           .layerCount = 1}};
+
+  VkDependencyInfo dependency_info{.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO,
+                                   .dependencyFlags = 0,
+                                   .imageMemoryBarrierCount = 1,
+                                   .pImageMemoryBarriers = &image_barrier};
+  vkCmdPipelineBarrier2(cmd, &dependency_info);
+}
+
+Engine::~Engine() {
+  // prepare()がデバイスの作成前に失敗した場合、破棄するのはインスタンスと
+  // サーフェスだけ
+  if (context.device == VK_NULL_HANDLE) {
+    if (context.surface != VK_NULL_HANDLE) {
+      vkDestroySurfaceKHR(context.instance, context.surface, nullptr);
+    }
+    if (context.instance.instance != VK_NULL_HANDLE) {
+      vkb::destroy_instance(context.instance);
+    }
+    SDL_DestroyWindow(context.window);
+    SDL_Quit();
+    return;
+  }
+
+  vkDeviceWaitIdle(context.device);
+
+  for (auto &per_frame : context.per_frame) {
+    teardown_per_frame(per_frame);
+  }
+
+  context.per_frame.clear();
+
+  for (auto semaphore : context.recycled_semaphores) {
+    vkDestroySemaphore(context.device, semaphore, nullptr);
+  }
+
+  if (context.pipeline != VK_NULL_HANDLE) {
+    vkDestroyPipeline(context.device, context.pipeline, nullptr);
+  }
+
+  if (context.pipeline_layout != VK_NULL_HANDLE) {
+    vkDestroyPipelineLayout(context.device, context.pipeline_layout, nullptr);
+  }
+
+  for (VkImageView image_view : context.swapchain_image_views) {
+    vkDestroyImageView(context.device, image_view, nullptr);
+  }
+
+  // ヘッドレスモードのオフスクリーンイメージ
+  for (size_t i = 0; i < context.offscreen_allocations.size(); ++i) {
+    vmaDestroyImage(context.vma_allocator, context.swapchain_images[i],
+                    context.offscreen_allocations[i]);
+  }
+
+  vkb::destroy_swapchain(context.swapchain);
+
+  if (context.surface != VK_NULL_HANDLE) {
+    vkDestroySurfaceKHR(context.instance, context.surface, nullptr);
+    context.surface = VK_NULL_HANDLE;
+  }
+
+  if (context.descriptorSetLayout != VK_NULL_HANDLE) {
+    vkDestroyDescriptorSetLayout(context.device, context.descriptorSetLayout,
+                                 nullptr);
+    context.descriptorSetLayout = VK_NULL_HANDLE;
+  }
+  if (context.descriptorPool != VK_NULL_HANDLE) {
+    vkDestroyDescriptorPool(context.device, context.descriptorPool, nullptr);
+    context.descriptorPool = VK_NULL_HANDLE;
+  }
+
+  vkDestroyImageView(context.device, context.depthImageView, nullptr);
+  vmaDestroyImage(context.vma_allocator, context.depthImage,
+                  context.depthAllocation);
+
+  for (auto *geometry : {&context.vertexBuffer, &context.indexBuffer,
+                         &context.indexBuffer16}) {
+    if (geometry->buffer.buffer != VK_NULL_HANDLE) {
+      vmaDestroyBuffer(context.vma_allocator, geometry->buffer.buffer,
+                       geometry->buffer.allocation);
+    }
+  }
+  context.meshBufferMap.clear();
+
+  context.uploader.reset();
+
+  vmaDestroyAllocator(context.vma_allocator);
+
+  if (context.commandPool != VK_NULL_HANDLE) {
+    vkDestroyCommandPool(context.device, context.commandPool, nullptr);
+  }
+
+  vkb::destroy_device(context.device);
+  vkb::destroy_instance(context.instance);
+
+  SDL_DestroyWindow(context.window);
+  SDL_Quit();
+}
+
+VkFormat Engine::findSupportedFormat(const std::vector<VkFormat> &candidates,
+                                     VkImageTiling tiling,
+                                     VkFormatFeatureFlags features) {
+  for (VkFormat format : candidates) {
+    VkFormatProperties props;
+    vkGetPhysicalDeviceFormatProperties(context.physicalDevice, format, &props);
+
+    if (tiling == VK_IMAGE_TILING_LINEAR &&
+        (props.linearTilingFeatures & features) == features) {
+      return format;
+    } else if (tiling == VK_IMAGE_TILING_OPTIMAL &&
+               (props.optimalTilingFeatures & features) == features) {
+      return format;
+    }
+  }
+
+  throw std::runtime_error("failed to find supported format!");
+}
+
+VkFormat Engine::findDepthFormat() {
+  return findSupportedFormat(
+      {VK_FORMAT_D32_SFLOAT, VK_FORMAT_D32_SFLOAT_S8_UINT,
+       VK_FORMAT_D24_UNORM_S8_UINT},
+      VK_IMAGE_TILING_OPTIMAL, VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT);
+}
+
+void Engine::init_depth() {
+  context.depthFormat = findDepthFormat();
+
+  VkImageCreateInfo imageInfo{};
+  imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+  imageInfo.imageType = VK_IMAGE_TYPE_2D;
+  imageInfo.extent = {context.swapchain_dimensions.width,
+                      context.swapchain_dimensions.height, 1};
+  imageInfo.mipLevels = 1;
+  imageInfo.arrayLayers = 1;
+  imageInfo.format = context.depthFormat;
+  imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+  imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+  imageInfo.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+  imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+  imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+  VmaAllocationCreateInfo allocCreateInfo{};
+  allocCreateInfo.usage = VMA_MEMORY_USAGE_GPU_ONLY;
+  allocCreateInfo.requiredFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+
+  VK_CHECK(vmaCreateImage(context.vma_allocator, &imageInfo, &allocCreateInfo,
+                          &context.depthImage, &context.depthAllocation,
+                          nullptr));
+
+  VkImageViewCreateInfo viewInfo{};
+  viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+  viewInfo.image = context.depthImage;
+  viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+  viewInfo.format = context.depthFormat;
+  viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
+  viewInfo.subresourceRange.baseMipLevel = 0;
+  viewInfo.subresourceRange.levelCount = 1;
+  viewInfo.subresourceRange.baseArrayLayer = 0;
+  viewInfo.subresourceRange.layerCount = 1;
+
+  VK_CHECK(vkCreateImageView(context.device, &viewInfo, nullptr,
+                             &context.depthImageView));
+}
+
+bool Engine::prepare() {
+  if (volkInitialize() != VK_SUCCESS) {
+    throw std::runtime_error("failed to initialize volk");
+  }
+  // ヘッドレスモードではウィンドウもサーフェスも作らない
+  if (!headless) {
+    if (!SDL_Init(SDL_INIT_VIDEO)) {
+      throw std::runtime_error("failed to initialize SDL");
+    }
+    context.window = SDL_CreateWindow("Triangle14dr", windowWidth,
+                                      windowHeight, SDL_WINDOW_VULKAN);
+    if (context.window == nullptr) {
+      throw std::runtime_error("failed to create window");
+    }
+  }
+
+  init_instance();
+
+  if (!headless) {
+    if (!SDL_Vulkan_CreateSurface(context.window, context.instance, nullptr,
+                                  &context.surface)) {
+      throw std::runtime_error("failed to create surface");
+    }
+
+    if (!context.surface) {
+      throw std::runtime_error("Failed to create window surface.");
+    }
+  }
+
+  context.swapchain_dimensions.width = windowWidth;
+  context.swapchain_dimensions.height = windowHeight;
+
+  init_device();
+
+  collect_nodes();
+
+  init_vertex_buffer();
+
+  if (headless) {
+    init_offscreen();
+  } else {
+    init_swapchain();
+  }
+
+  init_ubo();
+
+  init_depth();
+
+  init_pipeline();
+
+  return true;
+}
+
+void Engine::mainLoop() {
+  bool running = true;
+  while (running) {
+    SDL_Event event;
+    while (SDL_PollEvent(&event)) {
+      if (event.type == SDL_EVENT_QUIT) {
+        running = false;
+      }
+      if (event.type == SDL_EVENT_WINDOW_RESIZED) {
+      }
+    }
+    update();
+  }
+  vkDeviceWaitIdle(context.device);
+  for (auto &per_frame : context.per_frame) {
+    read_timestamps(per_frame);
+  }
+}
+
+void Engine::renderFrames(uint32_t frameCount) {
+  auto start = std::chrono::steady_clock::now();
+  for (uint32_t i = 0; i < frameCount; ++i) {
+    update();
+  }
+  vkDeviceWaitIdle(context.device);
+  for (auto &per_frame : context.per_frame) {
+    read_timestamps(per_frame);
+  }
+  std::chrono::duration<double, std::milli> elapsed =
+      std::chrono::steady_clock::now() - start;
+  LOGI("Rendered {} frames in {:.3f} ms ({:.3f} ms per frame)", frameCount,
+       elapsed.count(), elapsed.count() / std::max(frameCount, 1u));
+}
+
+void Engine::update() {
+  auto frame = timings.scope("frame");
+
+  // 前のフレームのGPU完了待ちも含む
+  auto acquiring = timings.scope("acquire");
+  auto res = acquire_next_swapchain_image(&context.currentIndex);
+
+  if (res == VK_SUBOPTIMAL_KHR || res == VK_ERROR_OUT_OF_DATE_KHR) {
+    if (!resize(context.swapchain_dimensions.width,
+                context.swapchain_dimensions.height)) {
+      LOGI("Resize failed");
+    }
+    res = acquire_next_swapchain_image(&context.currentIndex);
+  }
+  acquiring.end();
+
+  if (res != VK_SUCCESS) {
+    vkQueueWaitIdle(context.queue);
+    return;
+  }
+
+  {
+    auto scope = timings.scope("collect_nodes");
+    collect_nodes();
+  }
+  {
+    auto scope = timings.scope("update_meshes");
+    update_meshes(context.per_frame[context.currentIndex]);
+  }
+  {
+    auto scope = timings.scope("update_ubo");
+    update_ubo(context.per_frame[context.currentIndex]);
+  }
+  render(context.currentIndex);
+
+  // ヘッドレスモードでは表示しない
+  if (headless) {
+    return;
+  }
+
+  auto presenting = timings.scope("present");
+  res = present_image(context.currentIndex);
+
+  if (res == VK_SUBOPTIMAL_KHR || res == VK_ERROR_OUT_OF_DATE_KHR) {
+    if (!resize(context.swapchain_dimensions.width,
+                context.swapchain_dimensions.height)) {
+      LOGI("Resize failed");
+    }
+  } else if (res != VK_SUCCESS) {
+    LOGE("Failed to present swapchain image.");
+  }
+}
+
+bool Engine::resize(const uint32_t, const uint32_t) {
+  if (context.device == VK_NULL_HANDLE) {
+    return false;
+  }
+
+  VkSurfaceCapabilitiesKHR surface_properties;
+  VK_CHECK(vkGetPhysicalDeviceSurfaceCapabilitiesKHR(
+      context.physicalDevice, context.surface, &surface_properties));
+
+  if (surface_properties.currentExtent.width ==
+          context.swapchain_dimensions.width &&
+      surface_properties.currentExtent.height ==
+          context.swapchain_dimensions.height) {
+    return false;
+  }
+
+  vkDeviceWaitIdle(context.device);
+
+  init_swapchain();
+  return true;
+}
+
+VkSurfaceFormatKHR
+Engine::selectSurfaceFormat(VkPhysicalDevice gpu, VkSurfaceKHR surface,
+                            std::vector<VkFormat> const &preferred_formats) {
+  uint32_t surface_format_count;
+  vkGetPhysicalDeviceSurfaceFormatsKHR(gpu, surface, &surface_format_count,
+                                       nullptr);
+  assert(0 < surface_format_count);
+  std::vector<VkSurfaceFormatKHR> supported_surface_formats(
+      surface_format_count);
+  vkGetPhysicalDeviceSurfaceFormatsKHR(gpu, surface, &surface_format_count,
+                                       supported_surface_formats.data());
+
+  auto it = std::ranges::find_if(
+      supported_surface_formats,
+      [&preferred_formats](VkSurfaceFormatKHR surface_format) {
+        return std::ranges::any_of(preferred_formats,
+                                   [&surface_format](VkFormat format) {
+                                     return format == surface_format.format;
+                                   });
+      });
+
+  return it != supported_surface_formats.end() ? *it
+                                               : supported_surface_formats[0];
+}
+
+VkCommandBuffer Engine::beginSingleTimeCommands() {
+  VkCommandBufferAllocateInfo allocInfo{};
+  allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+  allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+  allocInfo.commandPool = context.commandPool;
+  allocInfo.commandBufferCount = 1;
+
+  VkCommandBuffer commandBuffer;
+  vkAllocateCommandBuffers(context.device, &allocInfo, &commandBuffer);
+
+  VkCommandBufferBeginInfo beginInfo{};
+  beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+  beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+  vkBeginCommandBuffer(commandBuffer, &beginInfo);
+
+  return commandBuffer;
+}
+
+void Engine::endSingleTimeCommands(VkCommandBuffer commandBuffer) {
+  vkEndCommandBuffer(commandBuffer);
+
+  VkSubmitInfo submitInfo{};
+  submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+  submitInfo.commandBufferCount = 1;
+  submitInfo.pCommandBuffers = &commandBuffer;
+
+  vkQueueSubmit(context.queue, 1, &submitInfo, VK_NULL_HANDLE);
+  vkQueueWaitIdle(context.queue);
+
+  vkFreeCommandBuffers(context.device, context.commandPool, 1, &commandBuffer);
+}
+
+AllocatedBuffer Engine::createBuffer(VkDeviceSize size,
+                                     VkBufferUsageFlags usage,
+                                     VmaMemoryUsage memoryUsage) {
+  VkBufferCreateInfo bufferInfo{};
+  bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+  bufferInfo.size = size;
+  bufferInfo.usage = usage;
+  bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+  VmaAllocationCreateInfo allocationInfo{};
+  allocationInfo.usage = memoryUsage;
+
+  VkBuffer buffer;
+  VmaAllocation allocation;
+  VK_CHECK(vmaCreateBuffer(context.vma_allocator, &bufferInfo, &allocationInfo,
+                           &buffer, &allocation, nullptr));
+
+  return {buffer, allocation};
+}
+
+void Engine::copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer,
+                        VkDeviceSize size) {
+  VkCommandBuffer commandBuffer = beginSingleTimeCommands();
+
+  VkBufferCopy copyRegion{};
+  copyRegion.size = size;
+  vkCmdCopyBuffer(commandBuffer, srcBuffer, dstBuffer, 1, &copyRegion);
+
+  endSingleTimeCommands(commandBuffer);
+}
+
+void Engine::addNode(const std::shared_ptr<Node> &node) {
+  if (node->transformStore() != transforms) {
+    throw std::runtime_error("node belongs to a different transform store");
+  }
+  if (!node->isRoot()) {
+    throw std::runtime_error("only root nodes can be added to the engine");
+  }
+  if (!rootSet.insert(node.get()).second) {
+    throw std::runtime_error("node has already been added to the engine");
+  }
+  roots.push_back(node);
+}
+
+void Engine::collect_nodes() {
+  // カリングと詳細度の選択にワールド行列を使うので、先に更新しておく
+  transforms->update(&jobs);
+
+  // 他のノードの子になったルートは親から辿られるので、ルートから外す
+  std::erase_if(roots, [this](const std::shared_ptr<Node> &root) {
+    if (root->isRoot()) {
+      return false;
+    }
+    rootSet.erase(root.get());
+    return true;
+  });
+
+  // 深さ優先でメッシュを持つノードを集める。ノードの集合が変わった時だけ
+  // BVHを作り直し、それ以外は動いたノードの分だけ更新する
+  collectMeshNodes(roots, meshNodes);
+  if (bvh.matches(meshNodes)) {
+    bvh.refit(*transforms);
+  } else {
+    bvh.build(meshNodes);
+    meshNodesChanged = true;
+  }
+
+  // 視錐台と交わるノードをBVHから集める。完全に内側の部分木は子を調べずに
+  // まとめて加え、外側の部分木はノード毎の判定をしない
+  visibleNodes.clear();
+  bvh.query(Frustum::fromMatrix(camera_uniforms().viewProj), visibleNodes);
+  std::size_t numberOfCulled = meshNodes.size() - visibleNodes.size();
+
+  // メッシュと詳細度の組の初出順にグループ分けする。同じグループのノードは
+  // 連続して並ぶ
+  buildDrawGroups(
+      visibleNodes, [this](const Node &node) { return select_lod(node); },
+      nodes, drawGroups);
+
+  DrawStats current{nodes.size(), drawGroups.size(), numberOfCulled};
+  for (const auto &group : drawGroups) {
+    current.numberOfTriangles += group.instanceCount *
+                                 group.mesh->lod(group.lod).numberOfIndices() /
+                                 3;
+  }
+  if (current.numberOfNodes != stats.numberOfNodes ||
+      current.numberOfDrawCalls != stats.numberOfDrawCalls ||
+      current.numberOfCulledNodes != stats.numberOfCulledNodes) {
+    LOGI("Drawing {} nodes with {} draw calls ({} saved by instancing), "
+         "{} triangles, {} nodes culled",
+         current.numberOfNodes, current.numberOfDrawCalls,
+         current.drawCallsSaved(), current.numberOfTriangles,
+         current.numberOfCulledNodes);
+  }
+  stats = current;
+}
+
+/**
+ * ウィンドウ座標を通る視線と最初に交わるノード
+ *
+ * 座標をニアクリップ面とファークリップ面に逆射影し、その間の
+ * 線分をBVHのバウンディングボックスと比較する。
+ */
+Node *Engine::pick(float x, float y) const {
+  const auto &dimensions = context.swapchain_dimensions;
+  if (dimensions.width == 0 || dimensions.height == 0) {
+    return nullptr;
+  }
+  // 射影行列はyを反転しているので、画面の上端がy = -1になる
+  glm::vec2 ndc(2.0f * x / dimensions.width - 1.0f,
+                2.0f * y / dimensions.height - 1.0f);
+  glm::mat4 inverseViewProj = glm::inverse(camera_uniforms().viewProj);
+  glm::vec4 nearPoint = inverseViewProj * glm::vec4(ndc, 0.0f, 1.0f);
+  glm::vec4 farPoint = inverseViewProj * glm::vec4(ndc, 1.0f, 1.0f);
+  glm::vec3 origin = glm::vec3(nearPoint) / nearPoint.w;
+  glm::vec3 direction = glm::vec3(farPoint) / farPoint.w - origin;
+  return bvh.raycast(origin, direction, 1.0f).node;
+}
+
+/**
+ * 画面上の誤差が閾値以下になる最も粗い詳細度を選ぶ
+ *
+ * 詳細度の誤差はメッシュの単位なので、ノードの最大の軸方向の拡大率で
+ * ワールド座標の長さにし、ワールド座標のバウンディングスフィアの最も近い点
+ * での1単位の長さのピクセル数を掛けて画面上の誤差とする。
+ */
+uint32_t Engine::select_lod(const Node &node) const {
+  const Mesh &mesh = *node.mesh();
+  if (mesh.numberOfLods() == 1) {
+    return 0;
+  }
+  BoundingSphere bounds = node.worldBoundingSphere();
+  float distance =
+      std::max(glm::length(bounds.center - eye) - bounds.radius, NEAR_PLANE);
+  float pixelsPerUnit = context.swapchain_dimensions.height /
+                        (2.0f * std::tan(FIELD_OF_VIEW * 0.5f) * distance);
+  float scale = maxAxisScale(node.worldMatrix());
+
+  uint32_t lod = 0;
+  while (lod + 1 < mesh.numberOfLods() &&
+         mesh.lodError(lod + 1) * scale * pixelsPerUnit <=
+             lodErrorThreshold) {
+    ++lod;
+  }
+  return lod;
+}
@@ -0,0 +1,410 @@
+#pragma once
+
+#include <VkBootstrap.h>
+
+#include <glm/glm.hpp>
+#include <vulkan/vk_enum_string_helper.h>
+// #include <vulkan/vulkan.h>
+
+#include <SDL3/SDL.h>
+#include <SDL3/SDL_vulkan.h>
+
+#include "bvh.hpp"
+#include "common.hpp"
+#include "draw_groups.hpp"
+#include "job_system.hpp"
+#include "offset_allocator.hpp"
+#include "profiler.hpp"
+#include "transform_store.hpp"
+#include "types.hpp"
+#include "uniforms.hpp"
+#include "upload_batcher.hpp"
+#include "vertex_format.hpp"
+
+#include <memory>
+#include <numbers>
+#include <unordered_map>
+#include <unordered_set>
+
+class Node;
+class Mesh;
+
+struct AllocatedBuffer {
+  VkBuffer buffer = VK_NULL_HANDLE;
+  VmaAllocation allocation = VK_NULL_HANDLE;
+};
+
+// ranges of the shared vertex and index buffers holding one level of detail
+struct MeshLodBuffer {
+  uint32_t vertexOffset = 0;
+  uint32_t vertexCount = 0;
+  uint32_t firstIndex = 0;
+  uint32_t indexCount = 0;
+};
+
+// a mesh uploaded to the shared vertex and index buffers
+struct MeshBuffer {
+  // level 0 is the mesh itself, followed by its coarser levels of detail
+  std::vector<MeshLodBuffer> lods;
+  // 16-bit indices live in indexBuffer16, 32-bit ones in indexBuffer
+  VkIndexType indexType = VK_INDEX_TYPE_UINT32;
+  // last frame in which a node of the scene had the mesh
+  uint64_t lastUsedFrame = 0;
+};
+
+// device-local buffer that the meshes are sub-allocated from
+struct GeometryBuffer {
+  AllocatedBuffer buffer;
+  // allocates elements of elementSize bytes
+  OffsetAllocator allocator;
+  VkDeviceSize elementSize = 0;
+  VkBufferUsageFlags usage = 0;
+};
+
+// draw calls issued for the last collected scene
+struct DrawStats {
+  // nodes inside the view frustum
+  std::size_t numberOfNodes = 0;
+  std::size_t numberOfDrawCalls = 0;
+  // nodes with a mesh skipped by frustum culling
+  std::size_t numberOfCulledNodes = 0;
+  // triangles of the selected levels of detail, summed over all instances
+  std::size_t numberOfTriangles = 0;
+  // draw calls avoided by instancing, compared to one per node
+  std::size_t drawCallsSaved() const {
+    return numberOfNodes - numberOfDrawCalls;
+  }
+};
+
+class Engine {
+  // initial number of nodes each per-frame node buffer can hold
+  static constexpr std::size_t INITIAL_NUMBER_OF_NODES = 32;
+  // initial number of vertices and indices of the shared geometry buffers
+  static constexpr uint32_t INITIAL_GEOMETRY_CAPACITY = 1 << 16;
+  // size of the staging ring used for uploads
+  static constexpr VkDeviceSize UPLOAD_STAGING_SIZE = 16 << 20;
+  // projection
+  // vertical field of view, 60 degrees
+  static constexpr float FIELD_OF_VIEW = std::numbers::pi_v<float> / 3.0f;
+  static constexpr float NEAR_PLANE = 0.1f;
+  static constexpr float FAR_PLANE = 10.0f;
+  // offscreen images rendered to in rotation in headless mode
+  static constexpr uint32_t HEADLESS_IMAGE_COUNT = 3;
+  static constexpr VkFormat HEADLESS_FORMAT = VK_FORMAT_R8G8B8A8_SRGB;
+
+  struct SwapchainDimensions {
+    uint32_t width = 0;
+    uint32_t height = 0;
+    VkFormat format = VK_FORMAT_UNDEFINED;
+  };
+
+  struct PerFrame {
+    VkFence queue_submit_fence = VK_NULL_HANDLE;
+    VkCommandPool primary_command_pool = VK_NULL_HANDLE;
+    VkCommandBuffer primary_command_buffer = VK_NULL_HANDLE;
+    VkSemaphore swapchain_acquire_semaphore = VK_NULL_HANDLE;
+    VkSemaphore swapchain_release_semaphore = VK_NULL_HANDLE;
+
+    VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+    // camera uniforms, written once per frame
+    AllocatedBuffer cameraBuffer;
+    CameraUniforms *cameraBufferMapped = nullptr;
+    // storage buffer with the NodeUniforms of every node
+    AllocatedBuffer nodeBuffer;
+    // persistently mapped pointer to nodeBuffer
+    NodeUniforms *nodeBufferMapped = nullptr;
+    // one indirect draw command per DrawGroup, at most one per node
+    AllocatedBuffer drawCommandBuffer;
+    VkDrawIndexedIndirectCommand *drawCommandBufferMapped = nullptr;
+    // number of nodes nodeBuffer and drawCommandBuffer can hold
+    std::size_t nodeBufferCapacity = 0;
+    // buffers replaced by a larger one, destroyed after queue_submit_fence
+    std::vector<AllocatedBuffer> retiredBuffers;
+    // meshes no longer drawn, freed after queue_submit_fence
+    std::vector<MeshBuffer> retiredMeshes;
+    // timestamps before and after the rendering pass; null when the graphics
+    // queue has no timestamp support
+    VkQueryPool timestampQueryPool = VK_NULL_HANDLE;
+    // true once the frame's timestamps have been submitted and not yet read
+    bool timestampsPending = false;
+    Profiler::Clock::time_point submitTime;
+  };
+
+  struct Context {
+    // Base resources
+    vkb::Instance instance;
+    SDL_Window *window = nullptr;
+    vkb::PhysicalDevice physicalDevice;
+    vkb::Device device;
+    VkQueue queue = VK_NULL_HANDLE;
+    // largest drawCount of a single vkCmdDrawIndexedIndirect
+    uint32_t maxDrawIndirectCount = 1;
+    // nanoseconds per timestamp tick, and the valid bits of a timestamp on
+    // the graphics queue (0 without timestamp support)
+    float timestampPeriod = 0.0f;
+    uint64_t timestampMask = 0;
+    vkb::Swapchain swapchain;
+    SwapchainDimensions swapchain_dimensions;
+    VkSurfaceKHR surface = VK_NULL_HANDLE;
+    int32_t graphics_queue_index = -1;
+    // dedicated transfer queue if there is one, the graphics queue otherwise
+    VkQueue transfer_queue = VK_NULL_HANDLE;
+    int32_t transfer_queue_index = -1;
+    std::vector<VkImageView> swapchain_image_views;
+    // swapchain images, or the offscreen images in headless mode
+    std::vector<VkImage> swapchain_images;
+    // allocations of the offscreen images; empty with a swapchain
+    std::vector<VmaAllocation> offscreen_allocations;
+    VkPipeline pipeline = VK_NULL_HANDLE;
+    VkPipelineLayout pipeline_layout = VK_NULL_HANDLE;
+    std::vector<VkSemaphore> recycled_semaphores;
+    std::vector<PerFrame> per_frame;
+    uint32_t currentIndex = -1;
+
+    // command pool for transfer
+    VkCommandPool commandPool = VK_NULL_HANDLE;
+
+    // batched uploads of mesh data
+    std::unique_ptr<UploadBatcher> uploader;
+
+    // VMA
+    VmaAllocator vma_allocator = VK_NULL_HANDLE;
+
+    // Vertex Buffer
+    GeometryBuffer vertexBuffer;
+    GeometryBuffer indexBuffer;
+    GeometryBuffer indexBuffer16;
+    std::unordered_map<std::shared_ptr<Mesh>, MeshBuffer> meshBufferMap;
+    // incremented by every update()
+    uint64_t frameCount = 0;
+
+    // UBO
+    VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
+    VkDescriptorSetLayout descriptorSetLayout = VK_NULL_HANDLE;
+
+    // depth resources
+    VkFormat depthFormat = VK_FORMAT_UNDEFINED;
+    VkImage depthImage = VK_NULL_HANDLE;
+    VmaAllocation depthAllocation = VK_NULL_HANDLE;
+    VkImageView depthImageView = VK_NULL_HANDLE;
+  };
+
+public:
+  // workerCount threads update the scene in addition to the calling thread
+  explicit Engine(unsigned workerCount = JobSystem::defaultWorkerCount())
+      : jobs(workerCount) {}
+
+  ~Engine();
+
+  bool prepare();
+
+  void mainLoop();
+
+  // render frameCount frames and wait until the last one has finished
+  void renderFrames(uint32_t frameCount);
+
+  void update();
+
+  bool resize(const uint32_t width, const uint32_t height);
+
+  void init_instance();
+
+  void init_device();
+
+  void init_vertex_buffer();
+
+  void update_meshes(PerFrame &per_frame);
+
+  MeshBuffer &upload_mesh(const std::shared_ptr<Mesh> &mesh);
+
+  GeometryBuffer &index_buffer(VkIndexType indexType) {
+    return indexType == VK_INDEX_TYPE_UINT16 ? context.indexBuffer16
+                                             : context.indexBuffer;
+  }
+
+  uint32_t allocate_geometry(GeometryBuffer &geometry, uint32_t count);
+
+  void grow_geometry(GeometryBuffer &geometry, uint32_t capacity);
+
+  void init_ubo();
+
+  // view and projection of the camera for the current render target
+  CameraUniforms camera_uniforms() const;
+
+  void update_ubo(PerFrame &per_frame);
+
+  void create_node_buffer(PerFrame &per_frame, std::size_t capacity);
+
+  void reserve_node_buffer(PerFrame &per_frame, std::size_t numberOfNodes);
+
+  void release_retired_buffers(PerFrame &per_frame);
+
+  void init_per_frame(PerFrame &per_frame);
+
+  void teardown_per_frame(PerFrame &per_frame);
+
+  void init_swapchain();
+
+  // offscreen colour images replacing the swapchain in headless mode
+  void init_offscreen();
+
+  // wait until the frame's previous submission has finished and recycle its
+  // resources
+  void wait_for_frame(PerFrame &per_frame);
+
+  // record the GPU time of the frame's last rendering pass, if it completed
+  void read_timestamps(PerFrame &per_frame);
+
+  VkShaderModule load_shader_module(const char *path);
+
+  void init_pipeline();
+
+  void init_depth();
+
+  VkResult acquire_next_swapchain_image(uint32_t *image);
+
+  void render(uint32_t swapchain_index);
+
+  VkResult present_image(uint32_t index);
+
+  // RGBA8 pixels of the last rendered frame, row by row; headless mode only
+  std::vector<uint8_t> readPixels();
+
+  // Utility Methos
+  void transitionImageLayout(VkCommandBuffer cmd, VkImage image,
+                             VkImageLayout oldLayout, VkImageLayout newLayout,
+                             VkAccessFlags2 srcAccessMask,
+                             VkAccessFlags2 dstAccessMask,
+                             VkPipelineStageFlags2 srcStage,
+                             VkPipelineStageFlags2 dstStage);
+
+  VkSurfaceFormatKHR
+  selectSurfaceFormat(VkPhysicalDevice gpu, VkSurfaceKHR surface,
+                      std::vector<VkFormat> const &preferred_formats = {
+                          VK_FORMAT_R8G8B8A8_SRGB, VK_FORMAT_B8G8R8A8_SRGB,
+                          VK_FORMAT_A8B8G8R8_SRGB_PACK32});
+
+  VkFormat findSupportedFormat(const std::vector<VkFormat> &candidates,
+                               VkImageTiling tiling,
+                               VkFormatFeatureFlags features);
+  VkFormat findDepthFormat();
+
+  // ワンショットコマンドバッファの開始
+  VkCommandBuffer beginSingleTimeCommands();
+
+  // ワンショットコマンドバッファの終了
+  void endSingleTimeCommands(VkCommandBuffer commandBuffer);
+
+  // バッファの作成
+  AllocatedBuffer createBuffer(VkDeviceSize size, VkBufferUsageFlags usage,
+                               VmaMemoryUsage memoryUsage);
+
+  // バッファーのコピー
+  void copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size);
+
+  // store that the transforms of added nodes must belong to; must be set
+  // before the first node is added
+  void setTransformStore(std::shared_ptr<TransformStore> store) {
+    transforms = std::move(store);
+  }
+
+  // add a root node to scene graph; a root that is later attached to another
+  // node is removed from the roots by the next collect_nodes() and has to be
+  // added again once it is detached
+  void addNode(const std::shared_ptr<Node> &node);
+
+  // collect the nodes to draw from the roots, skipping those outside the
+  // view frustum
+  void collect_nodes();
+
+  // nodes with a mesh as of the last collect_nodes(), for box queries and
+  // ray casts against their world bounds
+  const Bvh &spatialIndex() const { return bvh; }
+
+  // node whose world bounds the view ray through window coordinates (x, y)
+  // hits first, as of the last collect_nodes(); null if there is none
+  Node *pick(float x, float y) const;
+
+  // coarsest level of detail of the node's mesh whose projected error stays
+  // within lodErrorThreshold
+  uint32_t select_lod(const Node &node) const;
+
+  const DrawStats &drawStats() const { return stats; }
+
+  // CPU time of the phases of update() and GPU time of the rendering pass
+  Profiler &profiler() { return timings; }
+  const Profiler &profiler() const { return timings; }
+
+  // render into offscreen images without a window, surface or swapchain;
+  // must be set before prepare()
+  void setHeadless(bool headless) { this->headless = headless; }
+  bool isHeadless() const { return headless; }
+
+  uint32_t width() const { return context.swapchain_dimensions.width; }
+  uint32_t height() const { return context.swapchain_dimensions.height; }
+
+  void setWindowSize(uint32_t width, uint32_t height) {
+    windowWidth = width;
+    windowHeight = height;
+  }
+
+  void setCameraPosition(const glm::vec3 &eye, const glm::vec3 &center) {
+    this->eye = eye;
+    this->center = center;
+  }
+
+  void setLight(const glm::vec4 &light) {
+    this->light = light;
+  }
+
+  // largest screen-space error of a level of detail, in pixels
+  void setLodErrorThreshold(float pixels) { lodErrorThreshold = pixels; }
+
+private:
+  Context context;
+  // root nodes of the scene graph
+  std::vector<std::shared_ptr<Node>> roots;
+  // the nodes of roots, to reject duplicates in addNode()
+  std::unordered_set<const Node *> rootSet;
+  // nodes with a mesh, grouped by mesh; the index of a node is its instance
+  // index and its index in the node buffer
+  std::vector<Node *> nodes;
+  std::vector<DrawGroup> drawGroups;
+  // nodes with a mesh, and those of them inside the view frustum
+  std::vector<Node *> meshNodes;
+  std::vector<Node *> visibleNodes;
+  // meshNodes or their meshes changed since update_meshes() last made the
+  // meshes of the scene resident
+  bool meshNodesChanged = true;
+  // world bounds of meshNodes, refitted as nodes move
+  Bvh bvh;
+  // the draw commands of meshes with 16-bit indices come first in the
+  // indirect buffer, followed by those with 32-bit indices
+  uint32_t shortIndexDrawCount = 0;
+  // upload_mesh() converts the vertices and indices of each level of detail
+  // here before they are copied to the staging ring
+  std::vector<GpuVertex> encodedVertices;
+  std::vector<uint16_t> shortIndices;
+  DrawStats stats;
+  Profiler timings;
+  // transforms of all nodes in the scene
+  std::shared_ptr<TransformStore> transforms = TransformStore::defaultStore();
+  // worker threads for the per-frame updates
+  JobSystem jobs;
+
+  bool headless = false;
+
+  // window size, or image size in headless mode
+  uint32_t windowWidth = 800;
+  uint32_t windowHeight = 600;
+
+  // camera position
+  glm::vec3 eye{1.7f, 1.7f, 1.0f};
+  glm::vec3 center{0.0f, 0.0f, 0.0};
+  glm::vec3 up{0.0f, 0.0f, 1.0f};
+
+  // light position
+  glm::vec4 light{0.0f, 5.0f, 5.0f, 0.25f};
+
+  float lodErrorThreshold = 1.0f;
+};
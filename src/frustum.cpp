@@ -0,0 +1,80 @@
+#include "frustum.hpp"
+
+#include <bit>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define FRUSTUM_SSE 1
+#endif
+
+Frustum Frustum::fromMatrix(const glm::mat4 &viewProj) {
+  // rows of the matrix; a clip space position p is inside if
+  // -w <= x <= w, -w <= y <= w and 0 <= z <= w (Gribb and Hartmann)
+  glm::vec4 rows[4];
+  for (int i = 0; i < 4; ++i) {
+    rows[i] = {viewProj[0][i], viewProj[1][i], viewProj[2][i], viewProj[3][i]};
+  }
+  Frustum frustum;
+  frustum.planes[Left] = rows[3] + rows[0];
+  frustum.planes[Right] = rows[3] - rows[0];
+  frustum.planes[Bottom] = rows[3] + rows[1];
+  frustum.planes[Top] = rows[3] - rows[1];
+  frustum.planes[Near] = rows[2];
+  frustum.planes[Far] = rows[3] - rows[2];
+  for (auto &plane : frustum.planes) {
+    plane = plane / glm::length(glm::vec3(plane));
+  }
+  return frustum;
+}
+
+bool Frustum::intersects(const BoundingSphere &sphere) const {
+  for (const auto &plane : planes) {
+    if (glm::dot(glm::vec3(plane), sphere.center) + plane.w <
+        -sphere.radius) {
+      return false;
+    }
+  }
+  return true;
+}
+
+std::size_t cullSpheres(const Frustum &frustum,
+                        std::span<const glm::vec4> spheres, uint8_t *visible) {
+  std::size_t i = 0;
+  std::size_t count = 0;
+#ifdef FRUSTUM_SSE
+  // each plane component is broadcast and the spheres are transposed, so the
+  // four spheres are tested against a plane with three multiply-adds
+  __m128 planes[6][4];
+  for (int p = 0; p < 6; ++p) {
+    for (int c = 0; c < 4; ++c) {
+      planes[p][c] = _mm_set1_ps(frustum.planes[p][c]);
+    }
+  }
+  for (; i + 4 <= spheres.size(); i += 4) {
+    __m128 x = _mm_loadu_ps(&spheres[i].x);
+    __m128 y = _mm_loadu_ps(&spheres[i + 1].x);
+    __m128 z = _mm_loadu_ps(&spheres[i + 2].x);
+    __m128 r = _mm_loadu_ps(&spheres[i + 3].x);
+    _MM_TRANSPOSE4_PS(x, y, z, r);
+    __m128 negativeRadius = _mm_sub_ps(_mm_setzero_ps(), r);
+    __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+    for (const auto &plane : planes) {
+      __m128 distance = _mm_add_ps(
+          _mm_add_ps(_mm_mul_ps(x, plane[0]), _mm_mul_ps(y, plane[1])),
+          _mm_add_ps(_mm_mul_ps(z, plane[2]), plane[3]));
+      inside = _mm_and_ps(inside, _mm_cmpge_ps(distance, negativeRadius));
+    }
+    int mask = _mm_movemask_ps(inside);
+    for (int lane = 0; lane < 4; ++lane) {
+      visible[i + lane] = (mask >> lane) & 1;
+    }
+    count += std::popcount(static_cast<unsigned>(mask));
+  }
+#endif
+  for (; i < spheres.size(); ++i) {
+    const glm::vec4 &sphere = spheres[i];
+    visible[i] = frustum.intersects({glm::vec3(sphere), sphere.w});
+    count += visible[i];
+  }
+  return count;
+}
@@ -0,0 +1,40 @@
+#ifndef __FRUSTUM_HPP__
+#define __FRUSTUM_HPP__
+
+#include "common.hpp"
+#include "types.hpp"
+
+#include <array>
+#include <cstdint>
+#include <span>
+
+/**
+ * View frustum as six planes facing inwards.
+ *
+ * Each plane is stored as (normal, distance) with a unit normal, so that
+ * dot(plane, vec4(point, 1)) is the signed distance of point from the plane,
+ * positive inside.
+ */
+struct Frustum {
+  enum Plane { Left, Right, Bottom, Top, Near, Far };
+
+  std::array<glm::vec4, 6> planes;
+
+  // planes of the clip volume of viewProj, with depth from 0 to 1
+  static Frustum fromMatrix(const glm::mat4 &viewProj);
+
+  // false only if sphere is entirely outside one of the planes; spheres near
+  // a corner may be reported as intersecting
+  bool intersects(const BoundingSphere &sphere) const;
+};
+
+/**
+ * Test spheres (center, radius) against frustum, writing 1 to visible for the
+ * spheres that intersect it and 0 for the others. Four spheres are tested at
+ * a time with SSE where it is available. Returns the number of visible
+ * spheres.
+ */
+std::size_t cullSpheres(const Frustum &frustum,
+                        std::span<const glm::vec4> spheres, uint8_t *visible);
+
+#endif
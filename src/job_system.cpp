@@ -0,0 +1,108 @@
+#include "job_system.hpp"
+
+#include <algorithm>
+
+unsigned JobSystem::defaultWorkerCount() {
+  unsigned hardwareThreads = std::thread::hardware_concurrency();
+  return hardwareThreads > 1 ? hardwareThreads - 1 : 0;
+}
+
+JobSystem::JobSystem(unsigned workerCount) {
+  m_queues.reserve(workerCount + 1);
+  for (unsigned i = 0; i <= workerCount; ++i) {
+    m_queues.push_back(std::make_unique<Queue>());
+  }
+  m_workers.reserve(workerCount);
+  for (unsigned i = 0; i < workerCount; ++i) {
+    m_workers.emplace_back(&JobSystem::workerLoop, this, i + 1);
+  }
+}
+
+JobSystem::~JobSystem() {
+  {
+    std::lock_guard<std::mutex> lock(m_sleepMutex);
+    m_stop = true;
+  }
+  m_wakeUp.notify_all();
+  for (auto &worker : m_workers) {
+    worker.join();
+  }
+}
+
+void JobSystem::run(std::size_t count, std::size_t grainSize,
+                    const void *function,
+                    void (*invoke)(const void *, std::size_t, std::size_t)) {
+  grainSize = std::max<std::size_t>(grainSize, 1);
+  std::size_t jobCount = (count + grainSize - 1) / grainSize;
+  std::atomic<std::size_t> remaining{jobCount};
+
+  m_pendingJobs.fetch_add(jobCount, std::memory_order_relaxed);
+  // deal the ranges out round-robin; idle threads steal the rest
+  for (std::size_t j = 0; j < jobCount; ++j) {
+    std::size_t begin = j * grainSize;
+    std::size_t end = std::min(begin + grainSize, count);
+    auto &queue = *m_queues[j % m_queues.size()];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    queue.jobs.push_back({invoke, function, begin, end, &remaining});
+  }
+  {
+    // pairs with the predicate check of sleeping workers
+    std::lock_guard<std::mutex> lock(m_sleepMutex);
+  }
+  m_wakeUp.notify_all();
+
+  Job job;
+  while (remaining.load(std::memory_order_acquire) > 0) {
+    if (popOrSteal(0, job)) {
+      execute(job);
+    } else {
+      std::this_thread::yield();
+    }
+  }
+}
+
+void JobSystem::workerLoop(std::size_t index) {
+  Job job;
+  while (true) {
+    if (popOrSteal(index, job)) {
+      execute(job);
+      continue;
+    }
+    std::unique_lock<std::mutex> lock(m_sleepMutex);
+    m_wakeUp.wait(lock, [this] {
+      return m_stop || m_pendingJobs.load(std::memory_order_acquire) > 0;
+    });
+    if (m_stop) {
+      return;
+    }
+  }
+}
+
+bool JobSystem::popOrSteal(std::size_t index, Job &job) {
+  {
+    auto &own = *m_queues[index];
+    std::lock_guard<std::mutex> lock(own.mutex);
+    if (!own.jobs.empty()) {
+      job = own.jobs.back();
+      own.jobs.pop_back();
+      m_pendingJobs.fetch_sub(1, std::memory_order_relaxed);
+      return true;
+    }
+  }
+  for (std::size_t i = 1; i < m_queues.size(); ++i) {
+    auto &victim = *m_queues[(index + i) % m_queues.size()];
+    std::lock_guard<std::mutex> lock(victim.mutex);
+    if (!victim.jobs.empty()) {
+      job = victim.jobs.front();
+      victim.jobs.pop_front();
+      m_pendingJobs.fetch_sub(1, std::memory_order_relaxed);
+      return true;
+    }
+  }
+  return false;
+}
+
+void JobSystem::execute(const Job &job) {
+  job.invoke(job.function, job.begin, job.end);
+  job.remaining->fetch_sub(1, std::memory_order_acq_rel);
+}
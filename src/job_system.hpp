@@ -0,0 +1,88 @@
+#ifndef __JOB_SYSTEM_HPP__
+#define __JOB_SYSTEM_HPP__
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * Small work-stealing job system.
+ *
+ * Every worker thread owns a deque of jobs. A thread pops jobs from the back
+ * of its own deque and, when it runs dry, steals from the front of the other
+ * deques. The thread calling parallelFor() takes part in the work until the
+ * whole range has been processed.
+ */
+class JobSystem {
+  // a range of a parallelFor() call
+  struct Job {
+    void (*invoke)(const void *function, std::size_t begin, std::size_t end);
+    const void *function;
+    std::size_t begin;
+    std::size_t end;
+    std::atomic<std::size_t> *remaining;
+  };
+
+  struct Queue {
+    std::mutex mutex;
+    std::deque<Job> jobs;
+  };
+
+public:
+  // workerCount threads are started in addition to the calling thread
+  explicit JobSystem(unsigned workerCount = defaultWorkerCount());
+  ~JobSystem();
+
+  JobSystem(const JobSystem &) = delete;
+  JobSystem &operator=(const JobSystem &) = delete;
+
+  static unsigned defaultWorkerCount();
+
+  // number of threads that execute jobs, including the calling thread
+  unsigned threadCount() const {
+    return static_cast<unsigned>(m_workers.size()) + 1;
+  }
+
+  /**
+   * Call function(begin, end) for consecutive sub-ranges of [0, count) of at
+   * most grainSize elements, and wait until all of them have returned.
+   */
+  template <typename Function>
+  void parallelFor(std::size_t count, std::size_t grainSize,
+                   const Function &function) {
+    if (count == 0) {
+      return;
+    }
+    if (m_workers.empty() || count <= grainSize) {
+      function(std::size_t{0}, count);
+      return;
+    }
+    run(count, grainSize, &function,
+        [](const void *f, std::size_t begin, std::size_t end) {
+          (*static_cast<const Function *>(f))(begin, end);
+        });
+  }
+
+private:
+  void run(std::size_t count, std::size_t grainSize, const void *function,
+           void (*invoke)(const void *, std::size_t, std::size_t));
+  void workerLoop(std::size_t index);
+  bool popOrSteal(std::size_t index, Job &job);
+  static void execute(const Job &job);
+
+  // m_queues[0] belongs to the thread calling parallelFor()
+  std::vector<std::unique_ptr<Queue>> m_queues;
+  std::vector<std::thread> m_workers;
+
+  std::mutex m_sleepMutex;
+  std::condition_variable m_wakeUp;
+  std::atomic<std::size_t> m_pendingJobs{0};
+  bool m_stop = false;
+};
+
+#endif
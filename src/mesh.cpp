@@ -1,6 +1,10 @@
 #include "mesh.hpp"
 
+#include <algorithm>
+#include <cmath>
+
 IndexType Mesh::addVertex(const Vertex &vertex) {
+  m_bounds.reset();
   m_vertices.push_back(vertex);
   return static_cast<IndexType>(m_vertices.size() - 1);
 }
@@ -9,8 +13,45 @@ void Mesh::addIndex(IndexType index) {
   m_indices.push_back(static_cast<IndexType>(index));
 }
 
+#if defined(SCENEGRAPH_VERTEX_COLOR)
 void Mesh::setColor(const glm::vec3 &color) {
   for (auto &vertex : m_vertices) {
     vertex.color = color;
   }
 }
+#endif
+
+MeshOptimizationStats Mesh::optimize(uint32_t cacheSize) {
+  MeshOptimizationStats stats;
+  stats.before = vertexCacheStats(cacheSize);
+  auto clusters =
+      optimizeVertexCache(m_indices, m_vertices.size(), cacheSize);
+  optimizeOverdraw(m_indices, m_vertices, clusters);
+  optimizeVertexFetch(m_vertices, m_indices);
+  stats.after = vertexCacheStats(cacheSize);
+  for (auto &lod : m_lods) {
+    lod.mesh->optimize(cacheSize);
+  }
+  return stats;
+}
+
+const Mesh::Bounds &Mesh::computeBounds() const {
+  if (m_bounds) {
+    return *m_bounds;
+  }
+  Bounds bounds;
+  for (const auto &vertex : m_vertices) {
+    bounds.box.expand(vertex.position);
+  }
+  // the sphere is centred on the box; not minimal, but cheap and stable
+  if (!bounds.box.empty()) {
+    bounds.sphere.center = bounds.box.center();
+    float radius2 = 0.0f;
+    for (const auto &vertex : m_vertices) {
+      glm::vec3 d = vertex.position - bounds.sphere.center;
+      radius2 = std::max(radius2, glm::dot(d, d));
+    }
+    bounds.sphere.radius = std::sqrt(radius2);
+  }
+  return *(m_bounds = bounds);
+}
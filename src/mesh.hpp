@@ -2,25 +2,111 @@
 #define __MESH_HPP__
 
 #include "common.hpp"
+#include "mesh_optimizer.hpp"
 #include "types.hpp"
 
+#include <limits>
+#include <memory>
+#include <optional>
+#include <span>
+#include <utility>
+#include <vector>
+
+class Mesh;
+
+// a coarser version of a mesh
+struct MeshLod {
+  std::shared_ptr<Mesh> mesh;
+  // largest distance between this level and the full-detail surface, in
+  // mesh units
+  float error = 0.0f;
+};
+
 class Mesh {
   std::vector<Vertex> m_vertices;
   std::vector<IndexType> m_indices;
+  // coarser levels of detail, finest first
+  std::vector<MeshLod> m_lods;
+  // local bounds, computed on first use and reset when the vertices may have
+  // changed
+  struct Bounds {
+    BoundingBox box;
+    BoundingSphere sphere;
+  };
+  mutable std::optional<Bounds> m_bounds;
+
+  const Bounds &computeBounds() const;
 
 public:
+  Mesh() = default;
+  // take over prebuilt vertex and index arrays without copying them
+  Mesh(std::vector<Vertex> &&vertices, std::vector<IndexType> &&indices)
+      : m_vertices(std::move(vertices)), m_indices(std::move(indices)) {}
+
   IndexType addVertex(const Vertex &vertex);
   void addIndex(IndexType index);
+  // reserve room for the given total numbers of vertices and indices
+  void reserve(size_t numberOfVertices, size_t numberOfIndices) {
+    m_vertices.reserve(numberOfVertices);
+    m_indices.reserve(numberOfIndices);
+  }
 
+#if defined(SCENEGRAPH_VERTEX_COLOR)
+  // vertex colours are only drawn with SCENEGRAPH_VERTEX_COLOR, so without it
+  // this is not declared; use Node::setColor() instead
   void setColor(const glm::vec3 &color);
+#endif
+
+  // merge identical vertices and drop unreferenced ones; returns the number
+  // of vertices removed
+  std::size_t weld() {
+    m_bounds.reset();
+    return weldVertices(m_vertices, m_indices);
+  }
+
+  // reorder triangles and vertices of every level of detail for the vertex
+  // cache and for overdraw, see mesh_optimizer.hpp; the statistics are
+  // those of level 0
+  MeshOptimizationStats
+  optimize(uint32_t cacheSize = DEFAULT_VERTEX_CACHE_SIZE);
+  VertexCacheStats
+  vertexCacheStats(uint32_t cacheSize = DEFAULT_VERTEX_CACHE_SIZE) const {
+    return analyzeVertexCache(m_indices, m_vertices.size(), cacheSize);
+  }
 
-  const std::vector<Vertex> vertices() const { return m_vertices; }
-  const std::vector<IndexType> indices() const { return m_indices; }
-  Vertex &vertex(size_t i) { return m_vertices[i]; }
+  // views of the mesh data; valid until the mesh is modified
+  std::span<const Vertex> vertices() const { return m_vertices; }
+  std::span<const IndexType> indices() const { return m_indices; }
+  Vertex &vertex(size_t i) {
+    m_bounds.reset();
+    return m_vertices[i];
+  }
   const Vertex &vertex(size_t i) const { return m_vertices[i]; }
   IndexType index(size_t i) const { return m_indices[i]; }
   size_t size() const { return m_vertices.size(); }
   size_t numberOfIndices() const { return m_indices.size(); }
+  // true if every index fits into 16 bits; the indices are then uploaded
+  // as VK_INDEX_TYPE_UINT16
+  bool hasShortIndices() const {
+    return m_vertices.size() <= std::numeric_limits<uint16_t>::max() + 1;
+  }
+
+  // bounds in mesh coordinates
+  const BoundingSphere &bounds() const { return computeBounds().sphere; }
+  const BoundingBox &boundingBox() const { return computeBounds().box; }
+
+  // levels of detail; level 0 is this mesh, coarser levels are added in
+  // order with their geometric error
+  void addLod(const std::shared_ptr<Mesh> &mesh, float error) {
+    m_lods.push_back({mesh, error});
+  }
+  size_t numberOfLods() const { return m_lods.size() + 1; }
+  const Mesh &lod(size_t level) const {
+    return level == 0 ? *this : *m_lods[level - 1].mesh;
+  }
+  float lodError(size_t level) const {
+    return level == 0 ? 0.0f : m_lods[level - 1].error;
+  }
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,321 @@
+#include "mesh_optimizer.hpp"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <limits>
+#include <numeric>
+
+namespace {
+
+constexpr uint32_t NoVertex = std::numeric_limits<uint32_t>::max();
+
+// triangles using each vertex, as offsets into a flat array
+struct Adjacency {
+  std::vector<uint32_t> offsets;
+  std::vector<uint32_t> triangles;
+
+  Adjacency(std::span<const IndexType> indices, std::size_t vertexCount)
+      : offsets(vertexCount + 1, 0), triangles(indices.size()) {
+    for (IndexType index : indices) {
+      ++offsets[index + 1];
+    }
+    std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+    std::vector<uint32_t> next(offsets.begin(), offsets.end() - 1);
+    for (std::size_t i = 0; i < indices.size(); ++i) {
+      triangles[next[indices[i]]++] = static_cast<uint32_t>(i / 3);
+    }
+  }
+
+  std::span<const uint32_t> of(uint32_t vertex) const {
+    return std::span(triangles).subspan(
+        offsets[vertex], offsets[vertex + 1] - offsets[vertex]);
+  }
+};
+
+// attributes of a vertex; -0.0 is folded into 0.0 so that both compare and
+// hash alike
+std::array<float, 9> vertexKey(const Vertex &vertex) {
+  return {vertex.position.x + 0.0f, vertex.position.y + 0.0f,
+          vertex.position.z + 0.0f, vertex.normal.x + 0.0f,
+          vertex.normal.y + 0.0f,   vertex.normal.z + 0.0f,
+          vertex.color.x + 0.0f,    vertex.color.y + 0.0f,
+          vertex.color.z + 0.0f};
+}
+
+uint32_t hashKey(const std::array<float, 9> &key) {
+  uint32_t hash = 2166136261u;
+  for (float value : key) {
+    hash = (hash ^ std::bit_cast<uint32_t>(value)) * 16777619u;
+  }
+  // the low bits select the bucket, so mix the high bits into them
+  hash ^= hash >> 15;
+  hash *= 0x2c1b3c6du;
+  hash ^= hash >> 12;
+  return hash;
+}
+
+} // namespace
+
+VertexCacheStats analyzeVertexCache(std::span<const IndexType> indices,
+                                    std::size_t vertexCount,
+                                    uint32_t cacheSize) {
+  VertexCacheStats stats;
+  if (indices.empty()) {
+    return stats;
+  }
+  // a vertex is cached if it was inserted within the last cacheSize misses
+  std::vector<uint64_t> insertedAt(vertexCount, 0);
+  uint64_t misses = 0;
+  for (IndexType index : indices) {
+    if (insertedAt[index] == 0 || misses + 1 - insertedAt[index] > cacheSize) {
+      insertedAt[index] = ++misses;
+    }
+  }
+
+  std::size_t referenced = 0;
+  for (uint64_t time : insertedAt) {
+    referenced += time != 0;
+  }
+  stats.acmr = static_cast<double>(misses) / (indices.size() / 3);
+  stats.atvr = static_cast<double>(misses) / referenced;
+  return stats;
+}
+
+std::vector<std::size_t> optimizeVertexCache(std::span<IndexType> indices,
+                                             std::size_t vertexCount,
+                                             uint32_t cacheSize) {
+  const std::size_t triangleCount = indices.size() / 3;
+  std::vector<std::size_t> clusters;
+  if (triangleCount == 0) {
+    return clusters;
+  }
+
+  Adjacency adjacency(indices, vertexCount);
+  // triangles not yet emitted that use each vertex
+  std::vector<uint32_t> live(vertexCount);
+  for (uint32_t v = 0; v < vertexCount; ++v) {
+    live[v] = static_cast<uint32_t>(adjacency.of(v).size());
+  }
+  std::vector<uint64_t> cacheTime(vertexCount, 0);
+  std::vector<uint8_t> emitted(triangleCount, 0);
+  std::vector<uint32_t> deadEnd;
+  std::vector<uint32_t> candidates;
+  std::vector<IndexType> output;
+  output.reserve(indices.size());
+
+  uint64_t time = cacheSize + 1;
+  uint32_t cursor = 0;
+  // continue at a recently used vertex with live triangles, or at the next
+  // one in input order; both start a new cluster
+  auto skipDeadEnd = [&]() -> uint32_t {
+    while (!deadEnd.empty()) {
+      uint32_t vertex = deadEnd.back();
+      deadEnd.pop_back();
+      if (live[vertex] > 0) {
+        return vertex;
+      }
+    }
+    while (cursor < vertexCount) {
+      if (live[cursor] > 0) {
+        return cursor;
+      }
+      ++cursor;
+    }
+    return NoVertex;
+  };
+
+  uint32_t fanning = skipDeadEnd();
+  clusters.push_back(0);
+  // cache misses before the current cluster
+  uint64_t clusterStart = time;
+  while (fanning != NoVertex) {
+    // emit all remaining triangles around the fanning vertex
+    candidates.clear();
+    for (uint32_t triangle : adjacency.of(fanning)) {
+      if (emitted[triangle]) {
+        continue;
+      }
+      emitted[triangle] = 1;
+      for (int k = 0; k < 3; ++k) {
+        IndexType vertex = indices[triangle * 3 + k];
+        output.push_back(vertex);
+        deadEnd.push_back(vertex);
+        candidates.push_back(vertex);
+        --live[vertex];
+        if (time - cacheTime[vertex] > cacheSize) {
+          cacheTime[vertex] = time++;
+        }
+      }
+    }
+
+    // prefer the candidate that stays in the cache longest while all of its
+    // remaining triangles are emitted
+    uint32_t next = NoVertex;
+    uint64_t bestPriority = 0;
+    for (uint32_t vertex : candidates) {
+      if (live[vertex] == 0) {
+        continue;
+      }
+      uint64_t priority = 0;
+      if (time - cacheTime[vertex] + 2 * live[vertex] <= cacheSize) {
+        priority = time - cacheTime[vertex];
+      }
+      if (next == NoVertex || priority > bestPriority) {
+        next = vertex;
+        bestPriority = priority;
+      }
+    }
+    std::size_t clusterTriangles = output.size() / 3 - clusters.back();
+    uint64_t clusterMisses = time - clusterStart;
+    if (next == NoVertex) {
+      // hard boundary: the fan ran into a dead end
+      next = skipDeadEnd();
+      if (next != NoVertex) {
+        clusters.push_back(output.size() / 3);
+        clusterStart = time;
+      }
+    } else if (clusterMisses >= cacheSize &&
+               clusterMisses + cacheSize <=
+                   CLUSTER_ACMR_THRESHOLD * clusterTriangles) {
+      // soft boundary: the cache has been refilled since the cluster began,
+      // and refilling it once more if the clusters are reordered keeps the
+      // cluster's ACMR within the threshold
+      clusters.push_back(output.size() / 3);
+      clusterStart = time;
+    }
+    fanning = next;
+  }
+
+  std::copy(output.begin(), output.end(), indices.begin());
+  return clusters;
+}
+
+void optimizeOverdraw(std::span<IndexType> indices,
+                      std::span<const Vertex> vertices,
+                      std::span<const std::size_t> clusters) {
+  const std::size_t triangleCount = indices.size() / 3;
+  if (clusters.size() < 2) {
+    return;
+  }
+
+  auto triangleData = [&](std::size_t triangle, glm::vec3 &centroid,
+                          glm::vec3 &areaNormal) {
+    const glm::vec3 &a = vertices[indices[triangle * 3 + 0]].position;
+    const glm::vec3 &b = vertices[indices[triangle * 3 + 1]].position;
+    const glm::vec3 &c = vertices[indices[triangle * 3 + 2]].position;
+    centroid = (a + b + c) / 3.0f;
+    // twice the area, pointing along the face normal
+    areaNormal = glm::cross(b - a, c - a);
+  };
+
+  glm::vec3 meshCentroid(0.0f);
+  float meshArea = 0.0f;
+  for (std::size_t t = 0; t < triangleCount; ++t) {
+    glm::vec3 centroid, areaNormal;
+    triangleData(t, centroid, areaNormal);
+    float area = glm::length(areaNormal);
+    meshCentroid += centroid * area;
+    meshArea += area;
+  }
+  if (meshArea > 0.0f) {
+    meshCentroid /= meshArea;
+  }
+
+  // clusters facing away from the mesh centre are likely to occlude the
+  // others, so they are drawn first
+  struct Cluster {
+    std::size_t begin;
+    std::size_t end;
+    float outwardness;
+  };
+  std::vector<Cluster> sorted(clusters.size());
+  for (std::size_t i = 0; i < clusters.size(); ++i) {
+    Cluster &cluster = sorted[i];
+    cluster.begin = clusters[i];
+    cluster.end = i + 1 < clusters.size() ? clusters[i + 1] : triangleCount;
+    glm::vec3 centroid(0.0f), normal(0.0f);
+    float area = 0.0f;
+    for (std::size_t t = cluster.begin; t < cluster.end; ++t) {
+      glm::vec3 triangleCentroid, areaNormal;
+      triangleData(t, triangleCentroid, areaNormal);
+      float triangleArea = glm::length(areaNormal);
+      centroid += triangleCentroid * triangleArea;
+      normal += areaNormal;
+      area += triangleArea;
+    }
+    if (area > 0.0f) {
+      centroid /= area;
+    }
+    float length = glm::length(normal);
+    cluster.outwardness =
+        length > 0.0f ? glm::dot(centroid - meshCentroid, normal / length)
+                      : 0.0f;
+  }
+  std::stable_sort(sorted.begin(), sorted.end(),
+                   [](const Cluster &a, const Cluster &b) {
+                     return a.outwardness > b.outwardness;
+                   });
+
+  std::vector<IndexType> output;
+  output.reserve(indices.size());
+  for (const Cluster &cluster : sorted) {
+    output.insert(output.end(), indices.begin() + cluster.begin * 3,
+                  indices.begin() + cluster.end * 3);
+  }
+  std::copy(output.begin(), output.end(), indices.begin());
+}
+
+std::size_t weldVertices(std::vector<Vertex> &vertices,
+                         std::span<IndexType> indices) {
+  std::vector<uint8_t> referenced(vertices.size(), 0);
+  for (IndexType index : indices) {
+    referenced[index] = 1;
+  }
+
+  // open addressing with linear probing; slots hold indices into welded
+  std::size_t tableSize = std::bit_ceil(std::max<std::size_t>(
+      16, vertices.size() + vertices.size() / 2));
+  std::vector<uint32_t> table(tableSize, NoVertex);
+  std::vector<std::array<float, 9>> keys;
+  std::vector<Vertex> welded;
+  std::vector<uint32_t> remap(vertices.size(), NoVertex);
+  for (std::size_t v = 0; v < vertices.size(); ++v) {
+    if (!referenced[v]) {
+      continue;
+    }
+    auto key = vertexKey(vertices[v]);
+    std::size_t slot = hashKey(key) & (tableSize - 1);
+    while (table[slot] != NoVertex && keys[table[slot]] != key) {
+      slot = (slot + 1) & (tableSize - 1);
+    }
+    if (table[slot] == NoVertex) {
+      table[slot] = static_cast<uint32_t>(welded.size());
+      keys.push_back(key);
+      welded.push_back(vertices[v]);
+    }
+    remap[v] = table[slot];
+  }
+
+  for (IndexType &index : indices) {
+    index = static_cast<IndexType>(remap[index]);
+  }
+  std::size_t removed = vertices.size() - welded.size();
+  vertices = std::move(welded);
+  return removed;
+}
+
+void optimizeVertexFetch(std::vector<Vertex> &vertices,
+                         std::span<IndexType> indices) {
+  std::vector<uint32_t> remap(vertices.size(), NoVertex);
+  std::vector<Vertex> reordered;
+  reordered.reserve(vertices.size());
+  for (IndexType &index : indices) {
+    if (remap[index] == NoVertex) {
+      remap[index] = static_cast<uint32_t>(reordered.size());
+      reordered.push_back(vertices[index]);
+    }
+    index = static_cast<IndexType>(remap[index]);
+  }
+  vertices = std::move(reordered);
+}
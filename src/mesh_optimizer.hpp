@@ -0,0 +1,77 @@
+#ifndef __MESH_OPTIMIZER_HPP__
+#define __MESH_OPTIMIZER_HPP__
+
+#include "common.hpp"
+#include "types.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+/**
+ * Reordering passes for indexed triangle lists, run on the CPU before a
+ * mesh is uploaded.
+ *
+ * optimizeVertexCache() orders the triangles for a post-transform vertex
+ * cache with the Tipsify algorithm (Sander et al. 2007). The clusters it
+ * returns are reordered by optimizeOverdraw() so that outward-facing parts
+ * are drawn first, and optimizeVertexFetch() finally renumbers the vertices
+ * in the order they are first referenced.
+ */
+
+// FIFO cache size assumed by the passes and the statistics
+inline constexpr uint32_t DEFAULT_VERTEX_CACHE_SIZE = 16;
+
+// largest ACMR of a cluster, including a full cache refill at its start, up
+// to which optimizeVertexCache() ends clusters at cache flushes; Tipsify's
+// lambda
+inline constexpr double CLUSTER_ACMR_THRESHOLD = 0.75;
+
+struct VertexCacheStats {
+  // average cache miss ratio, transformed vertices per triangle (>= 0.5)
+  double acmr = 0.0;
+  // average transform to vertex ratio, transformed vertices per vertex
+  // (>= 1.0)
+  double atvr = 0.0;
+};
+
+struct MeshOptimizationStats {
+  VertexCacheStats before;
+  VertexCacheStats after;
+};
+
+// simulate a FIFO cache of cacheSize vertices over the triangles
+VertexCacheStats
+analyzeVertexCache(std::span<const IndexType> indices, std::size_t vertexCount,
+                   uint32_t cacheSize = DEFAULT_VERTEX_CACHE_SIZE);
+
+/**
+ * Reorder the triangles of indices in place for a cache of cacheSize
+ * vertices. Returns the first triangle of each cluster, a run of triangles
+ * that ends at a dead end of the fanning, or where the cache has been
+ * flushed and the cluster stays within CLUSTER_ACMR_THRESHOLD.
+ */
+std::vector<std::size_t>
+optimizeVertexCache(std::span<IndexType> indices, std::size_t vertexCount,
+                    uint32_t cacheSize = DEFAULT_VERTEX_CACHE_SIZE);
+
+// reorder the clusters of optimizeVertexCache(), most outward-facing first
+void optimizeOverdraw(std::span<IndexType> indices,
+                      std::span<const Vertex> vertices,
+                      std::span<const std::size_t> clusters);
+
+/**
+ * Merge vertices with identical attributes, found with a hash table over
+ * their attribute bits, and drop vertices no index refers to. Indices are
+ * remapped and the first copy of each vertex keeps its relative order.
+ * Returns the number of vertices removed.
+ */
+std::size_t weldVertices(std::vector<Vertex> &vertices,
+                         std::span<IndexType> indices);
+
+// order the vertices by first use and drop unreferenced ones
+void optimizeVertexFetch(std::vector<Vertex> &vertices,
+                         std::span<IndexType> indices);
+
+#endif
@@ -0,0 +1,88 @@
+#include "mesh_simplifier.hpp"
+
+#include <cmath>
+#include <unordered_map>
+
+// cell size of the first level, relative to the bounding sphere radius
+static constexpr float INITIAL_CELL_SIZE = 1.0f / 16.0f;
+
+std::shared_ptr<Mesh> simplifyMesh(const Mesh &mesh, float cellSize) {
+  const BoundingSphere &bounds = mesh.bounds();
+  glm::vec3 origin = bounds.center - glm::vec3(bounds.radius);
+
+  // sums of the attributes of the vertices in each occupied cell
+  struct Cluster {
+    glm::vec3 position{0.0f};
+    glm::vec3 normal{0.0f};
+    glm::vec3 color{0.0f};
+    uint32_t count = 0;
+  };
+  std::vector<Cluster> clusters;
+  std::unordered_map<uint64_t, uint32_t> clusterOfCell;
+  std::vector<IndexType> clusterOfVertex(mesh.size());
+  for (std::size_t v = 0; v < mesh.size(); ++v) {
+    const Vertex &vertex = mesh.vertex(v);
+    glm::vec3 cell = glm::floor((vertex.position - origin) / cellSize);
+    // 21 bits per axis are plenty for the grids used for LODs
+    uint64_t key = (static_cast<uint64_t>(cell.x) & 0x1fffff) |
+                   (static_cast<uint64_t>(cell.y) & 0x1fffff) << 21 |
+                   (static_cast<uint64_t>(cell.z) & 0x1fffff) << 42;
+    auto [it, inserted] = clusterOfCell.try_emplace(
+        key, static_cast<uint32_t>(clusters.size()));
+    if (inserted) {
+      clusters.emplace_back();
+    }
+    Cluster &cluster = clusters[it->second];
+    cluster.position += vertex.position;
+    cluster.normal += vertex.normal;
+    cluster.color += vertex.color;
+    ++cluster.count;
+    clusterOfVertex[v] = it->second;
+  }
+
+  std::vector<Vertex> vertices(clusters.size());
+  for (std::size_t c = 0; c < clusters.size(); ++c) {
+    const Cluster &cluster = clusters[c];
+    float weight = 1.0f / cluster.count;
+    vertices[c].position = cluster.position * weight;
+    float length = glm::length(cluster.normal);
+    vertices[c].normal =
+        length > 0.0f ? cluster.normal / length : glm::vec3(0.0f);
+    vertices[c].color = cluster.color * weight;
+  }
+
+  std::vector<IndexType> indices;
+  auto source = mesh.indices();
+  for (std::size_t i = 0; i + 2 < source.size(); i += 3) {
+    IndexType a = clusterOfVertex[source[i]];
+    IndexType b = clusterOfVertex[source[i + 1]];
+    IndexType c = clusterOfVertex[source[i + 2]];
+    if (a != b && b != c && a != c) {
+      indices.insert(indices.end(), {a, b, c});
+    }
+  }
+
+  auto simplified =
+      std::make_shared<Mesh>(std::move(vertices), std::move(indices));
+  // clusters whose triangles all collapsed are no longer referenced
+  simplified->weld();
+  return simplified;
+}
+
+void buildLods(Mesh &mesh, int levels) {
+  float cellSize = mesh.bounds().radius * INITIAL_CELL_SIZE;
+  if (cellSize <= 0.0f) {
+    return;
+  }
+  const Mesh *previous = &mesh;
+  for (int level = 0; level < levels; ++level, cellSize *= 2.0f) {
+    auto lod = simplifyMesh(mesh, cellSize);
+    if (lod->numberOfIndices() == 0 ||
+        lod->numberOfIndices() >= previous->numberOfIndices()) {
+      break;
+    }
+    // a vertex moves at most to the far corner of its cell
+    mesh.addLod(lod, cellSize * std::sqrt(3.0f));
+    previous = lod.get();
+  }
+}
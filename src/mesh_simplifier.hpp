@@ -0,0 +1,24 @@
+#ifndef __MESH_SIMPLIFIER_HPP__
+#define __MESH_SIMPLIFIER_HPP__
+
+#include "mesh.hpp"
+
+#include <memory>
+
+/**
+ * Simplify a mesh by vertex clustering: the vertices are binned into a grid
+ * of cellSize, each cell is replaced by the average of its vertices and the
+ * triangles that collapse are dropped. Works on any mesh and runs in linear
+ * time; the result deviates from the input by at most the cell diagonal.
+ */
+std::shared_ptr<Mesh> simplifyMesh(const Mesh &mesh, float cellSize);
+
+/**
+ * Add up to levels coarser levels of detail to mesh with simplifyMesh(),
+ * doubling the cell size for each level. Stops early once a level no longer
+ * removes triangles. The levels are optimised along with the mesh by
+ * Mesh::optimize().
+ */
+void buildLods(Mesh &mesh, int levels);
+
+#endif
@@ -1,17 +1,174 @@
 #include "node.hpp"
+#include "mesh.hpp"
+
+#include <stdexcept>
+#include <vector>
+
+Node::Node(const std::shared_ptr<TransformStore> &store,
+           const std::shared_ptr<Mesh> &mesh)
+    : m_store(store), m_transform(store->create()), m_mesh(mesh) {}
+
+Node::~Node() {
+  // Children are released by the outermost destructor on this thread, so
+  // destroying a deep hierarchy does not recurse once per level.
+  thread_local std::vector<std::shared_ptr<Node>> *pending = nullptr;
+  std::vector<std::shared_ptr<Node>> released;
+  bool outermost = pending == nullptr;
+  if (outermost) {
+    pending = &released;
+  }
+
+  while (m_firstChild) {
+    std::shared_ptr<Node> child = std::move(m_firstChild);
+    m_firstChild = std::move(child->m_nextSibling);
+    child->m_parent = nullptr;
+    child->m_prevSibling = nullptr;
+    // a child that is still referenced elsewhere becomes a root
+    m_store->setParent(child->m_transform, TransformStore::InvalidHandle);
+    pending->push_back(std::move(child));
+  }
+  m_lastChild = nullptr;
+
+  if (outermost) {
+    while (!released.empty()) {
+      std::shared_ptr<Node> node = std::move(released.back());
+      released.pop_back();
+      node.reset();
+    }
+    pending = nullptr;
+  }
+
+  m_store->destroy(m_transform);
+}
+
+void Node::unlink() {
+  if (m_parent == nullptr) {
+    return;
+  }
+  std::shared_ptr<Node> next = std::move(m_nextSibling);
+  if (next) {
+    next->m_prevSibling = m_prevSibling;
+  } else {
+    m_parent->m_lastChild = m_prevSibling;
+  }
+  // drops the link that owned this node; callers keep it alive
+  if (m_prevSibling) {
+    m_prevSibling->m_nextSibling = std::move(next);
+  } else {
+    m_parent->m_firstChild = std::move(next);
+  }
+  m_parent = nullptr;
+  m_prevSibling = nullptr;
+}
+
+void Node::addChild(const std::shared_ptr<Node> &child) {
+  if (child->m_store != m_store) {
+    throw std::runtime_error("child belongs to a different transform store");
+  }
+  // only a node with children can be an ancestor of this node
+  if (child->m_firstChild || child.get() == this) {
+    for (Node *node = this; node != nullptr; node = node->m_parent) {
+      if (node == child.get()) {
+        throw std::runtime_error("a node cannot be added to its own subtree");
+      }
+    }
+  }
+
+  std::shared_ptr<Node> keep = child;
+  child->unlink();
+
+  child->m_parent = this;
+  child->m_prevSibling = m_lastChild;
+  if (m_lastChild) {
+    m_lastChild->m_nextSibling = std::move(keep);
+  } else {
+    m_firstChild = std::move(keep);
+  }
+  m_lastChild = child.get();
+
+  m_store->setParent(child->m_transform, m_transform);
+}
+
+void Node::removeChild(const std::shared_ptr<Node> &child) {
+  if (child->m_parent != this) {
+    throw std::runtime_error("node is not a child of this node");
+  }
+  std::shared_ptr<Node> keep = child;
+  child->unlink();
+  m_store->setParent(child->m_transform, TransformStore::InvalidHandle);
+}
+
+void Node::reparent(const std::shared_ptr<Node> &parent) {
+  if (parent) {
+    parent->addChild(shared_from_this());
+  } else if (m_parent) {
+    m_parent->removeChild(shared_from_this());
+  }
+}
+
+Node::Range<Node::ChildIterator> Node::children() const {
+  return {ChildIterator(m_firstChild.get()), ChildIterator()};
+}
+
+Node::Range<Node::DepthFirstIterator> Node::depthFirst() {
+  return {DepthFirstIterator(this), DepthFirstIterator()};
+}
+
+Node::Range<Node::BreadthFirstIterator> Node::breadthFirst() {
+  return {BreadthFirstIterator(this), BreadthFirstIterator()};
+}
 
 glm::mat4 Node::localMatrix() const {
-  glm::mat4 modelMatrix = glm::mat4_cast(m_quat);
-  modelMatrix[3][0] = m_pos.x;
-  modelMatrix[3][1] = m_pos.y;
-  modelMatrix[3][2] = m_pos.z;
-  modelMatrix[3][3] = 1.0f;
-  return modelMatrix;
+  return m_store->localMatrix(m_transform);
 }
 
 glm::mat4 Node::worldMatrix() const {
-  if (std::shared_ptr<Node> r = m_parent.lock()) {
-    return r->worldMatrix() * localMatrix();
+  if (m_store->isDirty()) {
+    m_store->update();
+  }
+  return m_store->worldMatrix(m_transform);
+}
+
+BoundingSphere Node::worldBoundingSphere() const {
+  if (!m_mesh) {
+    return {};
+  }
+  return transformBounds(m_mesh->bounds(), worldMatrix());
+}
+
+BoundingBox Node::worldBoundingBox() const {
+  if (!m_mesh) {
+    return {};
+  }
+  return transformBounds(m_mesh->boundingBox(), worldMatrix());
+}
+
+Node::DepthFirstIterator &Node::DepthFirstIterator::operator++() {
+  if (m_node->m_firstChild) {
+    m_node = m_node->m_firstChild.get();
+    return *this;
+  }
+  skipChildren();
+  return *this;
+}
+
+void Node::DepthFirstIterator::skipChildren() {
+  while (m_node != m_root) {
+    if (m_node->m_nextSibling) {
+      m_node = m_node->m_nextSibling.get();
+      return;
+    }
+    m_node = m_node->m_parent;
+  }
+  m_node = nullptr;
+}
+
+Node::BreadthFirstIterator &Node::BreadthFirstIterator::operator++() {
+  Node *node = m_queue.front();
+  m_queue.pop_front();
+  for (Node *child = node->m_firstChild.get(); child != nullptr;
+       child = child->m_nextSibling.get()) {
+    m_queue.push_back(child);
   }
-  return localMatrix();
+  return *this;
 }
@@ -2,40 +2,207 @@
 #define __NODE_HPP__
 
 #include "common.hpp"
+#include "transform_store.hpp"
+#include "types.hpp"
 
+#include <deque>
+#include <iterator>
 #include <memory>
 
 class Mesh;
 
 class Node : public std::enable_shared_from_this<Node> {
-  std::weak_ptr<Node> m_parent;
-  glm::vec3 m_pos{0.0f, 0.0f, 0.0f};
-  glm::quat m_quat{glm::vec3{0.0f, 0.0f, 0.0f}};
+  // transform of this node lives in m_store
+  std::shared_ptr<TransformStore> m_store;
+  TransformStore::Handle m_transform;
   std::shared_ptr<Mesh> m_mesh;
+  // per-instance colour, multiplied with the vertex colours if the vertex
+  // layout has them
+  glm::vec4 m_color{1.0f};
+
+  // intrusive hierarchy links; a parent owns its first child and every
+  // child owns its next sibling
+  Node *m_parent = nullptr;
+  std::shared_ptr<Node> m_firstChild;
+  Node *m_lastChild = nullptr;
+  std::shared_ptr<Node> m_nextSibling;
+  Node *m_prevSibling = nullptr;
+
+  // remove this node from its parent's child list
+  void unlink();
 
 public:
-  Node() = default;
-  Node(const std::shared_ptr<Mesh> &mesh) : m_mesh(mesh) {}
+  class DepthFirstIterator;
+  class BreadthFirstIterator;
+  class ChildIterator;
+
+  template <typename Iterator> class Range {
+    Iterator m_begin;
+    Iterator m_end;
+
+  public:
+    Range(Iterator begin, Iterator end) : m_begin(begin), m_end(end) {}
+    Iterator begin() const { return m_begin; }
+    Iterator end() const { return m_end; }
+  };
+
+  Node() : Node(TransformStore::defaultStore()) {}
+  Node(const std::shared_ptr<Mesh> &mesh)
+      : Node(TransformStore::defaultStore(), mesh) {}
+  Node(const std::shared_ptr<TransformStore> &store,
+       const std::shared_ptr<Mesh> &mesh = nullptr);
+  ~Node();
+
+  Node(const Node &) = delete;
+  Node &operator=(const Node &) = delete;
+
   // position
-  void setPosition(const glm::vec3 &pos) { m_pos = pos; }
-  const glm::vec3 &position() const { return m_pos; }
+  void setPosition(const glm::vec3 &pos) {
+    m_store->setPosition(m_transform, pos);
+  }
+  const glm::vec3 &position() const { return m_store->position(m_transform); }
 
   // quat
-  void setQuat(const glm::quat &quat) { m_quat = quat; }
-  const glm::quat &quat() const { return m_quat; }
+  void setQuat(const glm::quat &quat) { m_store->setQuat(m_transform, quat); }
+  const glm::quat &quat() const { return m_store->quat(m_transform); }
 
   // euler angle
   void setEulerAngle(const glm::vec3 &angle) {
-    m_quat = glm::quat(glm::vec3(angle.x, angle.y, angle.z));
+    m_store->setQuat(m_transform,
+                     glm::quat(glm::vec3(angle.x, angle.y, angle.z)));
   }
-  glm::vec3 eulearAngle() const { return glm::eulerAngles(m_quat); }
+  glm::vec3 eulearAngle() const { return glm::eulerAngles(quat()); }
 
   // mesh
   void setMesh(const std::shared_ptr<Mesh> &mesh) { m_mesh = mesh; }
   const std::shared_ptr<Mesh> &mesh() const { return m_mesh; }
 
+  // color
+  void setColor(const glm::vec4 &color) { m_color = color; }
+  const glm::vec4 &color() const { return m_color; }
+
+  // hierarchy
+  // append child as the last child of this node, detaching it from its
+  // current parent first
+  void addChild(const std::shared_ptr<Node> &child);
+  // detach child; it becomes a root
+  void removeChild(const std::shared_ptr<Node> &child);
+  // move this node under parent, or make it a root if parent is null
+  void reparent(const std::shared_ptr<Node> &parent);
+
+  Node *parent() const { return m_parent; }
+  Node *firstChild() const { return m_firstChild.get(); }
+  Node *nextSibling() const { return m_nextSibling.get(); }
+  bool isRoot() const { return m_parent == nullptr; }
+
+  // traversal; depthFirst() and breadthFirst() include this node
+  Range<ChildIterator> children() const;
+  Range<DepthFirstIterator> depthFirst();
+  Range<BreadthFirstIterator> breadthFirst();
+
+  // transform
+  const std::shared_ptr<TransformStore> &transformStore() const {
+    return m_store;
+  }
+  TransformStore::Handle transformHandle() const { return m_transform; }
+
   glm::mat4 localMatrix() const;
+  // cached world matrix, brought up to date first if the store is dirty
   glm::mat4 worldMatrix() const;
+
+  // bounds of the mesh in world coordinates; empty without a mesh
+  BoundingSphere worldBoundingSphere() const;
+  BoundingBox worldBoundingBox() const;
+};
+
+/**
+ * Direct children of a node.
+ */
+class Node::ChildIterator {
+  Node *m_node = nullptr;
+
+public:
+  using iterator_category = std::forward_iterator_tag;
+  using value_type = Node;
+  using difference_type = std::ptrdiff_t;
+  using pointer = Node *;
+  using reference = Node &;
+
+  ChildIterator() = default;
+  explicit ChildIterator(Node *node) : m_node(node) {}
+
+  Node &operator*() const { return *m_node; }
+  Node *operator->() const { return m_node; }
+  ChildIterator &operator++() {
+    m_node = m_node->m_nextSibling.get();
+    return *this;
+  }
+  ChildIterator operator++(int) {
+    ChildIterator it = *this;
+    ++*this;
+    return it;
+  }
+  bool operator==(const ChildIterator &other) const {
+    return m_node == other.m_node;
+  }
+};
+
+/**
+ * Pre-order traversal of a subtree. Follows the sibling links, so it does not
+ * allocate.
+ */
+class Node::DepthFirstIterator {
+  Node *m_node = nullptr;
+  Node *m_root = nullptr;
+
+public:
+  using iterator_category = std::forward_iterator_tag;
+  using value_type = Node;
+  using difference_type = std::ptrdiff_t;
+  using pointer = Node *;
+  using reference = Node &;
+
+  DepthFirstIterator() = default;
+  explicit DepthFirstIterator(Node *root) : m_node(root), m_root(root) {}
+
+  Node &operator*() const { return *m_node; }
+  Node *operator->() const { return m_node; }
+  DepthFirstIterator &operator++();
+  DepthFirstIterator operator++(int) {
+    DepthFirstIterator it = *this;
+    ++*this;
+    return it;
+  }
+  // skip the children of the current node
+  void skipChildren();
+  bool operator==(const DepthFirstIterator &other) const {
+    return m_node == other.m_node;
+  }
+};
+
+/**
+ * Level-order traversal of a subtree.
+ */
+class Node::BreadthFirstIterator {
+  std::deque<Node *> m_queue;
+
+public:
+  using iterator_category = std::input_iterator_tag;
+  using value_type = Node;
+  using difference_type = std::ptrdiff_t;
+  using pointer = Node *;
+  using reference = Node &;
+
+  BreadthFirstIterator() = default;
+  explicit BreadthFirstIterator(Node *root) : m_queue{root} {}
+
+  Node &operator*() const { return *m_queue.front(); }
+  Node *operator->() const { return m_queue.front(); }
+  BreadthFirstIterator &operator++();
+  bool operator==(const BreadthFirstIterator &other) const {
+    return m_queue.empty() == other.m_queue.empty() &&
+           (m_queue.empty() || m_queue.front() == other.m_queue.front());
+  }
 };
 
-#endif
\ No newline at end of file
+#endif
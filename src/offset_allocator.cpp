@@ -0,0 +1,89 @@
+#include "offset_allocator.hpp"
+
+#include <iterator>
+#include <stdexcept>
+
+OffsetAllocator::OffsetAllocator(uint32_t capacity) { grow(capacity); }
+
+OffsetAllocator::Offset OffsetAllocator::allocate(uint32_t size) {
+  if (size == 0) {
+    throw std::invalid_argument("cannot allocate an empty range");
+  }
+  auto fit = m_freeBySize.lower_bound(size);
+  if (fit == m_freeBySize.end()) {
+    return InvalidOffset;
+  }
+  Offset offset = fit->second;
+  uint32_t rangeSize = fit->first;
+  eraseFreeRange(m_freeByOffset.find(offset));
+  if (rangeSize > size) {
+    insertFreeRange(offset + size, rangeSize - size);
+  }
+  m_allocations.emplace(offset, size);
+  m_usedSize += size;
+  return offset;
+}
+
+void OffsetAllocator::free(Offset offset) {
+  auto allocation = m_allocations.find(offset);
+  if (allocation == m_allocations.end()) {
+    throw std::invalid_argument("offset was not allocated");
+  }
+  uint32_t size = allocation->second;
+  m_allocations.erase(allocation);
+  m_usedSize -= size;
+
+  // merge with the free ranges on either side
+  auto next = m_freeByOffset.lower_bound(offset);
+  if (next != m_freeByOffset.end() && offset + size == next->first) {
+    size += next->second;
+    eraseFreeRange(next);
+    next = m_freeByOffset.lower_bound(offset);
+  }
+  if (next != m_freeByOffset.begin()) {
+    auto prev = std::prev(next);
+    if (prev->first + prev->second == offset) {
+      offset = prev->first;
+      size += prev->second;
+      eraseFreeRange(prev);
+    }
+  }
+  insertFreeRange(offset, size);
+}
+
+void OffsetAllocator::grow(uint32_t capacity) {
+  if (capacity <= m_capacity) {
+    return;
+  }
+  Offset offset = m_capacity;
+  uint32_t size = capacity - m_capacity;
+  m_capacity = capacity;
+
+  // extend a free range that ends at the old capacity
+  if (!m_freeByOffset.empty()) {
+    auto last = std::prev(m_freeByOffset.end());
+    if (last->first + last->second == offset) {
+      offset = last->first;
+      size += last->second;
+      eraseFreeRange(last);
+    }
+  }
+  insertFreeRange(offset, size);
+}
+
+void OffsetAllocator::insertFreeRange(Offset offset, uint32_t size) {
+  m_freeByOffset.emplace(offset, size);
+  m_freeBySize.emplace(size, offset);
+}
+
+void OffsetAllocator::eraseFreeRange(
+    std::map<Offset, uint32_t>::iterator range) {
+  auto [first, last] = m_freeBySize.equal_range(range->second);
+  for (auto it = first; it != last; ++it) {
+    if (it->second == range->first) {
+      m_freeBySize.erase(it);
+      break;
+    }
+  }
+  m_freeByOffset.erase(range);
+}
@@ -0,0 +1,52 @@
+#ifndef __OFFSET_ALLOCATOR_HPP__
+#define __OFFSET_ALLOCATOR_HPP__
+
+#include <cstdint>
+#include <limits>
+#include <map>
+#include <unordered_map>
+
+/**
+ * Sub-allocates ranges of a linear address space, such as the elements of a
+ * large GPU buffer.
+ *
+ * Free ranges are kept both by offset, to merge neighbours when a range is
+ * freed, and by size, so that allocate() picks the smallest range that fits.
+ * The allocator only does the bookkeeping; it never touches the memory.
+ */
+class OffsetAllocator {
+public:
+  using Offset = uint32_t;
+  static constexpr Offset InvalidOffset = std::numeric_limits<Offset>::max();
+
+  explicit OffsetAllocator(uint32_t capacity = 0);
+
+  // returns InvalidOffset if no free range of size elements is left
+  Offset allocate(uint32_t size);
+  void free(Offset offset);
+
+  // add the range [capacity(), capacity) to the free space
+  void grow(uint32_t capacity);
+
+  uint32_t capacity() const { return m_capacity; }
+  uint32_t usedSize() const { return m_usedSize; }
+  // size of the largest range allocate() can currently return
+  uint32_t largestFreeRange() const {
+    return m_freeBySize.empty() ? 0 : m_freeBySize.rbegin()->first;
+  }
+
+private:
+  void insertFreeRange(Offset offset, uint32_t size);
+  void eraseFreeRange(std::map<Offset, uint32_t>::iterator range);
+
+  uint32_t m_capacity = 0;
+  uint32_t m_usedSize = 0;
+  // free ranges, offset -> size
+  std::map<Offset, uint32_t> m_freeByOffset;
+  // free ranges, size -> offset
+  std::multimap<uint32_t, Offset> m_freeBySize;
+  // allocated ranges, offset -> size
+  std::unordered_map<Offset, uint32_t> m_allocations;
+};
+
+#endif
@@ -0,0 +1,158 @@
+#include "profiler.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <ostream>
+
+namespace {
+
+const char *trackName(Profiler::Track track) {
+  return track == Profiler::Track::Cpu ? "cpu" : "gpu";
+}
+
+// phase names are identifiers in practice, but keep the output valid JSON
+void writeString(std::ostream &out, std::string_view string) {
+  out << '"';
+  for (char c : string) {
+    if (c == '"' || c == '\\') {
+      out << '\\' << c;
+    } else if (static_cast<unsigned char>(c) >= 0x20) {
+      out << c;
+    }
+  }
+  out << '"';
+}
+
+// fixed-point output for the duration of a dump, restoring the stream after
+class FixedPoint {
+public:
+  FixedPoint(std::ostream &out, int precision)
+      : m_out(out), m_flags(out.flags()), m_precision(out.precision()) {
+    m_out << std::fixed << std::setprecision(precision);
+  }
+  ~FixedPoint() {
+    m_out.flags(m_flags);
+    m_out.precision(m_precision);
+  }
+
+private:
+  std::ostream &m_out;
+  std::ios_base::fmtflags m_flags;
+  std::streamsize m_precision;
+};
+
+} // namespace
+
+void Profiler::Scope::end() {
+  if (m_ended) {
+    return;
+  }
+  m_ended = true;
+  Clock::time_point now = Clock::now();
+  std::chrono::duration<double, std::milli> elapsed = now - m_start;
+  m_profiler->record(m_phase, m_start, elapsed.count());
+}
+
+Profiler::Profiler(std::size_t windowSize)
+    : m_windowSize(std::max<std::size_t>(windowSize, 1)),
+      m_epoch(Clock::now()) {}
+
+std::size_t Profiler::phase(std::string_view name, Track track) {
+  for (std::size_t i = 0; i < m_phases.size(); ++i) {
+    if (m_phases[i].track == track && m_phases[i].name == name) {
+      return i;
+    }
+  }
+  m_phases.push_back({std::string(name), track, {}, 0});
+  m_phases.back().samples.reserve(m_windowSize);
+  return m_phases.size() - 1;
+}
+
+void Profiler::record(std::size_t phase, Clock::time_point start,
+                      double milliseconds) {
+  Phase &p = m_phases[phase];
+  if (p.samples.size() < m_windowSize) {
+    p.samples.push_back({start, milliseconds});
+  } else {
+    p.samples[p.next] = {start, milliseconds};
+    p.next = (p.next + 1) % m_windowSize;
+  }
+}
+
+Profiler::Stats Profiler::summarize(const Phase &phase) {
+  Stats stats;
+  stats.count = phase.samples.size();
+  if (stats.count == 0) {
+    return stats;
+  }
+  std::vector<double> durations;
+  durations.reserve(stats.count);
+  double sum = 0.0;
+  for (const auto &sample : phase.samples) {
+    durations.push_back(sample.milliseconds);
+    sum += sample.milliseconds;
+  }
+  // nearest-rank percentile
+  std::size_t rank = static_cast<std::size_t>(
+      std::ceil(0.99 * static_cast<double>(stats.count)));
+  std::nth_element(durations.begin(), durations.begin() + (rank - 1),
+                   durations.end());
+  stats.p99 = durations[rank - 1];
+  stats.min = *std::min_element(durations.begin(), durations.end());
+  stats.average = sum / static_cast<double>(stats.count);
+  return stats;
+}
+
+Profiler::Stats Profiler::stats(std::string_view name, Track track) const {
+  for (const auto &phase : m_phases) {
+    if (phase.track == track && phase.name == name) {
+      return summarize(phase);
+    }
+  }
+  return {};
+}
+
+void Profiler::writeJson(std::ostream &out) const {
+  FixedPoint fixed(out, 4);
+  out << "{\"windowSize\": " << m_windowSize << ", \"phases\": [";
+  for (std::size_t i = 0; i < m_phases.size(); ++i) {
+    const Phase &phase = m_phases[i];
+    Stats stats = summarize(phase);
+    out << (i == 0 ? "\n  " : ",\n  ") << "{\"name\": ";
+    writeString(out, phase.name);
+    out << ", \"track\": \"" << trackName(phase.track)
+        << "\", \"count\": " << stats.count << ", \"minMs\": " << stats.min
+        << ", \"averageMs\": " << stats.average
+        << ", \"p99Ms\": " << stats.p99 << "}";
+  }
+  out << "\n]}\n";
+}
+
+void Profiler::writeChromeTrace(std::ostream &out) const {
+  // microseconds
+  FixedPoint fixed(out, 3);
+  out << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [";
+  bool first = true;
+  for (Track track : {Track::Cpu, Track::Gpu}) {
+    out << (first ? "\n  " : ",\n  ")
+        << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": "
+        << static_cast<int>(track) + 1 << ", \"args\": {\"name\": \""
+        << trackName(track) << "\"}}";
+    first = false;
+  }
+  for (const Phase &phase : m_phases) {
+    for (const Sample &sample : phase.samples) {
+      std::chrono::duration<double, std::micro> start =
+          sample.start - m_epoch;
+      out << ",\n  {\"name\": ";
+      writeString(out, phase.name);
+      out << ", \"cat\": \"" << trackName(phase.track)
+          << "\", \"ph\": \"X\", \"pid\": 1, \"tid\": "
+          << static_cast<int>(phase.track) + 1 << ", \"ts\": "
+          << start.count() << ", \"dur\": " << sample.milliseconds * 1000.0
+          << "}";
+    }
+  }
+  out << "\n]}\n";
+}
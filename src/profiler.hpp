@@ -0,0 +1,104 @@
+#ifndef __PROFILER_HPP__
+#define __PROFILER_HPP__
+
+#include <chrono>
+#include <cstddef>
+#include <iosfwd>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * Frame-phase timings over a rolling window.
+ *
+ * Every named phase keeps its last windowSize samples. CPU phases are
+ * measured by scopes, GPU phases are recorded from timestamp queries once
+ * their results are available. The window can be summarised as min, average
+ * and 99th percentile, or dumped as JSON or in the Chrome trace event format
+ * (chrome://tracing, Perfetto).
+ *
+ * Not thread-safe; phases are recorded by the thread running the frame.
+ */
+class Profiler {
+public:
+  using Clock = std::chrono::steady_clock;
+  static constexpr std::size_t DEFAULT_WINDOW_SIZE = 256;
+
+  enum class Track { Cpu, Gpu };
+
+  // durations in milliseconds over the samples in the window
+  struct Stats {
+    std::size_t count = 0;
+    double min = 0.0;
+    double average = 0.0;
+    double p99 = 0.0;
+  };
+
+  // measures from construction until end() or destruction
+  class Scope {
+  public:
+    Scope(Profiler &profiler, std::size_t phase)
+        : m_profiler(&profiler), m_phase(phase), m_start(Clock::now()) {}
+    ~Scope() { end(); }
+
+    Scope(const Scope &) = delete;
+    Scope &operator=(const Scope &) = delete;
+
+    void end();
+
+  private:
+    Profiler *m_profiler;
+    std::size_t m_phase;
+    Clock::time_point m_start;
+    bool m_ended = false;
+  };
+
+  explicit Profiler(std::size_t windowSize = DEFAULT_WINDOW_SIZE);
+
+  // time the CPU phase name until the returned scope ends
+  [[nodiscard]] Scope scope(std::string_view name) {
+    return Scope(*this, phase(name, Track::Cpu));
+  }
+
+  // add a sample that was measured elsewhere, e.g. by GPU timestamps
+  void record(std::string_view name, Track track, Clock::time_point start,
+              double milliseconds) {
+    record(phase(name, track), start, milliseconds);
+  }
+
+  Stats stats(std::string_view name, Track track = Track::Cpu) const;
+
+  // {"windowSize": n, "phases": [{"name", "track", "count", "min", ...}]}
+  void writeJson(std::ostream &out) const;
+
+  // complete ("X") events of every sample in the window; CPU and GPU phases
+  // are shown as two threads
+  void writeChromeTrace(std::ostream &out) const;
+
+private:
+  struct Sample {
+    Clock::time_point start;
+    double milliseconds;
+  };
+
+  struct Phase {
+    std::string name;
+    Track track;
+    // ring of the last windowSize samples; next is the oldest once full
+    std::vector<Sample> samples;
+    std::size_t next = 0;
+  };
+
+  std::size_t phase(std::string_view name, Track track);
+  void record(std::size_t phase, Clock::time_point start,
+              double milliseconds);
+  static Stats summarize(const Phase &phase);
+
+  std::size_t m_windowSize;
+  // in order of first use; a frame has few enough phases for a linear search
+  std::vector<Phase> m_phases;
+  // trace timestamps are relative to the creation of the profiler
+  Clock::time_point m_epoch;
+};
+
+#endif
@@ -1,5 +1,6 @@
 #include "mesh_box.hpp"
-#include "main.hpp"
+
+#include <algorithm>
 
 static int buildPlane(int startingIndice, float width, float height,
                       float translateX, float translateY, float translateZ,
@@ -69,6 +70,12 @@ static int buildPlane(int startingIndice, float width, float height,
   return startingIndice + (horizontalSegments + 1) * (verticalSegments + 1);
 }
 
+// room for the six faces
+static void reserve(int horizontalSegments, int verticalSegments, Mesh &mesh) {
+  mesh.reserve(6 * (horizontalSegments + 1) * (verticalSegments + 1),
+               36 * horizontalSegments * verticalSegments);
+}
+
 std::shared_ptr<Mesh> Box::generate(const glm::vec3 &halfExtents,
                                     int horizontalSegments,
                                     int verticalSegments) {
@@ -78,6 +85,7 @@ std::shared_ptr<Mesh> Box::generate(const glm::vec3 &halfExtents,
 
   float depth = halfExtents.z * 2.0f;
   auto mesh = std::make_shared<Mesh>();
+  reserve(horizontalSegments, verticalSegments, *mesh);
   int indice = 0;
   glm::vec3 color(1, 1, 1);
   // Top
@@ -107,6 +115,7 @@ std::shared_ptr<Mesh> Box::generate(const glm::vec3 &halfExtents,
   return mesh;
 }
 
+#if defined(SCENEGRAPH_VERTEX_COLOR)
 std::shared_ptr<Mesh> Box::generate(const glm::vec3 &halfExtents,
                                     int horizontalSegments,
                                     int verticalSegments,
@@ -115,6 +124,7 @@ std::shared_ptr<Mesh> Box::generate(const glm::vec3 &halfExtents,
   float height = halfExtents.y * 2.0f;
   float depth = halfExtents.z * 2.0f;
   auto mesh = std::make_shared<Mesh>();
+  reserve(horizontalSegments, verticalSegments, *mesh);
   int indice = 0;
   // Top
   indice = buildPlane(indice, width, height, 0.0f, 0.0f, depth * 0.5f, 0.0f,
@@ -151,6 +161,7 @@ std::shared_ptr<Mesh> Box::generate(const glm::vec3 &halfExtents,
   float height = halfExtents.y * 2.0f;
   float depth = halfExtents.z * 2.0f;
   auto mesh = std::make_shared<Mesh>();
+  reserve(horizontalSegments, verticalSegments, *mesh);
   int indice = 0;
   // Top
   indice = buildPlane(indice, width, height, 0.0f, 0.0f, depth * 0.5f, 0.0f,
@@ -178,3 +189,20 @@ std::shared_ptr<Mesh> Box::generate(const glm::vec3 &halfExtents,
                       verticalSegments, *mesh);
   return mesh;
 }
+#endif
+
+std::shared_ptr<Mesh> Box::generateLods(const glm::vec3 &halfExtents,
+                                        int horizontalSegments,
+                                        int verticalSegments, int levels) {
+  auto mesh = generate(halfExtents, horizontalSegments, verticalSegments);
+  for (int level = 0; level < levels; ++level) {
+    if (horizontalSegments == 1 && verticalSegments == 1) {
+      break;
+    }
+    horizontalSegments = std::max(horizontalSegments / 2, 1);
+    verticalSegments = std::max(verticalSegments / 2, 1);
+    mesh->addLod(generate(halfExtents, horizontalSegments, verticalSegments),
+                 0.0f);
+  }
+  return mesh;
+}
@@ -11,11 +11,20 @@ class Box {
 public:
   static std::shared_ptr<Mesh> generate(const glm::vec3 &halfExtents, int horizontalSegments,
                        int verticalSegments);
+#if defined(SCENEGRAPH_VERTEX_COLOR)
+  // with vertex colours only, see Mesh::setColor()
   static std::shared_ptr<Mesh> generate(const glm::vec3 &halfExtents, int horizontalSegments,
                        int verticalSegments, const glm::vec3 &color);
   static std::shared_ptr<Mesh> generate(const glm::vec3 &halfExtents, int horizontalSegments,
                        int verticalSegments,
                        const std::array<glm::vec3, 6> &colors);
+#endif
+  // mesh with up to levels coarser levels of detail, halving the number of
+  // segments for each level; the faces are flat, so every level has no
+  // geometric error
+  static std::shared_ptr<Mesh> generateLods(const glm::vec3 &halfExtents,
+                                            int horizontalSegments,
+                                            int verticalSegments, int levels);
 };
 
 #endif /* defined(__b3__b3Box__) */
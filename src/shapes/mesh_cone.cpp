@@ -1,16 +1,16 @@
 #include "mesh_cone.hpp"
-#include "main.hpp"
+#include <algorithm>
 #include <cmath>
 #include <numbers>
+#include <vector>
 
 static void build(float height, float topRadius, float bottomRadius,
                   int radialSegments, UpAxis up, int verticalSegments,
                   bool openEnded, [[maybe_unused]] const glm::vec2 &uv,
                   Mesh &mesh) {
-  // TODO:
   // 以下のアルゴリズムだと、上部と下部において、面積が0のTriangleができてしまう。
   // なので、頂点は追加するが、インデックスには追加しない頂点がある。
-  // このため、頂点のチェックを有効にするととエラーになる。
+  // これらの頂点と、底面や継ぎ目で重複する頂点は最後にweld()で取り除く。
 
   // float totalHeight;
   // if (openEnded) {
@@ -22,6 +22,26 @@ static void build(float height, float topRadius, float bottomRadius,
   float dR = bottomRadius - topRadius;
   float length = std::sqrt(height * height + dR * dR);
 
+  int totalNT;
+  if (openEnded) {
+    totalNT = verticalSegments;
+  } else {
+    totalNT = verticalSegments + 2;
+  }
+  mesh.reserve((totalNT + 1) * (radialSegments + 1),
+               6 * totalNT * radialSegments);
+
+  // 円周方向の三角関数は一度だけ計算する
+  // 継ぎ目の列は最初の列と同じ値になるようにする
+  std::vector<float> sinTheta(radialSegments + 1);
+  std::vector<float> cosTheta(radialSegments + 1);
+  for (int s = 0; s <= radialSegments; ++s) {
+    float theta = (s % radialSegments) * 2.0f * std::numbers::pi_v<float> /
+                  radialSegments;
+    sinTheta[s] = std::sin(theta);
+    cosTheta[s] = std::cos(theta);
+  }
+
   if (!openEnded) {
     // Create bottom
     for (int s = 0; s <= radialSegments; ++s) {
@@ -34,6 +54,8 @@ static void build(float height, float topRadius, float bottomRadius,
       vertex.normal.y = -1.0f;
       vertex.normal.z = 0.0f;
 
+      vertex.color = glm::vec3(1.0f);
+
       mesh.addVertex(vertex);
     }
   }
@@ -50,15 +72,16 @@ static void build(float height, float topRadius, float bottomRadius,
     float radius =
         bottomRadius - (bottomRadius - topRadius) * t / verticalSegments;
     for (int s = 0; s <= radialSegments; ++s) {
-      float theta = s * 2.0f * std::numbers::pi_v<float> / radialSegments;
       Vertex vertex;
-      vertex.position.x = radius * std::sin(theta);
+      vertex.position.x = radius * sinTheta[s];
       vertex.position.y = -(height / 2.0f) + (t * height / verticalSegments);
-      vertex.position.z = radius * std::cos(theta);
+      vertex.position.z = radius * cosTheta[s];
 
-      vertex.normal.x = std::sin(theta) * height / length;
+      vertex.normal.x = sinTheta[s] * height / length;
       vertex.normal.y = dR / length;
-      vertex.normal.z = std::cos(theta) * height / length;
+      vertex.normal.z = cosTheta[s] * height / length;
+
+      vertex.color = glm::vec3(1.0f);
 
       mesh.addVertex(vertex);
     }
@@ -76,17 +99,12 @@ static void build(float height, float topRadius, float bottomRadius,
       vertex.normal.y = 1.0f;
       vertex.normal.z = 0.0f;
 
+      vertex.color = glm::vec3(1.0f);
+
       mesh.addVertex(vertex);
     }
   }
 
-  int totalNT;
-  if (openEnded) {
-    totalNT = verticalSegments;
-  } else {
-    totalNT = verticalSegments + 2;
-  }
-
   for (int t = 0; t < totalNT; ++t) {
     for (int s = 0; s < radialSegments; ++s) {
 
@@ -153,6 +171,8 @@ static void build(float height, float topRadius, float bottomRadius,
       mesh.vertex(i).normal.z = ny;
     }
   }
+
+  mesh.weld();
 }
 
 std::shared_ptr<Mesh> Cone::generate(float height, float topRadius,
@@ -165,6 +185,7 @@ std::shared_ptr<Mesh> Cone::generate(float height, float topRadius,
   return mesh;
 }
 
+#if defined(SCENEGRAPH_VERTEX_COLOR)
 std::shared_ptr<Mesh> Cone::generate(float height, float topRadius,
                                      float bottomRadius, UpAxis up,
                                      int radialSegments, int verticalSegments,
@@ -174,3 +195,28 @@ std::shared_ptr<Mesh> Cone::generate(float height, float topRadius,
         openEnded, color, *mesh);
   return mesh;
 }
+#endif
+
+std::shared_ptr<Mesh> Cone::generateLods(float height, float topRadius,
+                                         float bottomRadius, UpAxis up,
+                                         int radialSegments,
+                                         int verticalSegments, bool openEnded,
+                                         int levels) {
+  auto mesh = generate(height, topRadius, bottomRadius, up, radialSegments,
+                       verticalSegments, openEnded);
+  // 側面は直線なので、ずれは円周方向の分割だけで決まる
+  float radius = std::max(topRadius, bottomRadius);
+  for (int level = 0; level < levels; ++level) {
+    radialSegments /= 2;
+    verticalSegments = std::max(verticalSegments / 2, 1);
+    if (radialSegments < 3) {
+      break;
+    }
+    float error =
+        radius * (1.0f - std::cos(std::numbers::pi_v<float> / radialSegments));
+    mesh->addLod(generate(height, topRadius, bottomRadius, up, radialSegments,
+                          verticalSegments, openEnded),
+                 error);
+  }
+  return mesh;
+}
@@ -12,9 +12,19 @@ public:
   static std::shared_ptr<Mesh> generate(float height, float topRadius, float bottomRadius,
                        UpAxis up, int radialSegments, int verticalSegments,
                        bool openEnded);
+#if defined(SCENEGRAPH_VERTEX_COLOR)
+  // with vertex colours only, see Mesh::setColor()
   static std::shared_ptr<Mesh> generate(float height, float topRadius, float bottomRadius,
                        UpAxis up, int radialSegments, int verticalSegments,
                        bool openEnded, const glm::vec3 &color);
+#endif
+  // mesh with up to levels coarser levels of detail, halving the number of
+  // segments for each level
+  static std::shared_ptr<Mesh> generateLods(float height, float topRadius,
+                                            float bottomRadius, UpAxis up,
+                                            int radialSegments,
+                                            int verticalSegments,
+                                            bool openEnded, int levels);
 };
 
 #endif
@@ -1,9 +1,12 @@
 #include "mesh_plane.hpp"
-#include "main.hpp"
+
+#include <algorithm>
 
 static void build(float width, float height,
                   const glm::vec2 &uv, UpAxis up,
                   int widthSegments, int heightSegments, Mesh &mesh) {
+  mesh.reserve((widthSegments + 1) * (heightSegments + 1),
+               6 * widthSegments * heightSegments);
   for (int i = 0; i <= widthSegments; ++i) {
     float x = -(width / 2) + i * (width / widthSegments);
 
@@ -81,6 +84,7 @@ std::shared_ptr<Mesh> Plane::generate(float width, float height, UpAxis up, int
   return mesh;
 }
 
+#if defined(SCENEGRAPH_VERTEX_COLOR)
 std::shared_ptr<Mesh> Plane::generate(float width, float height, UpAxis up, int widthSegments,
                      int heightSegments, const glm::vec3 &color) {
   auto mesh = std::make_shared<Mesh>();
@@ -88,3 +92,20 @@ std::shared_ptr<Mesh> Plane::generate(float width, float height, UpAxis up, int
   mesh->setColor(color);
   return mesh;
 }
+#endif
+
+std::shared_ptr<Mesh> Plane::generateLods(float width, float height, UpAxis up,
+                                          int widthSegments, int heightSegments,
+                                          int levels) {
+  auto mesh = generate(width, height, up, widthSegments, heightSegments);
+  for (int level = 0; level < levels; ++level) {
+    if (widthSegments == 1 && heightSegments == 1) {
+      break;
+    }
+    widthSegments = std::max(widthSegments / 2, 1);
+    heightSegments = std::max(heightSegments / 2, 1);
+    mesh->addLod(generate(width, height, up, widthSegments, heightSegments),
+                 0.0f);
+  }
+  return mesh;
+}
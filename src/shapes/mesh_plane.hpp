@@ -11,9 +11,18 @@ class Plane {
 public:
   static std::shared_ptr<Mesh> generate(float width, float height, UpAxis up,
                                         int widthSegments, int heightSegments);
+#if defined(SCENEGRAPH_VERTEX_COLOR)
+  // with vertex colours only, see Mesh::setColor()
   static std::shared_ptr<Mesh> generate(float width, float height, UpAxis up,
                                         int widthSegments, int heightSegments,
                                         const glm::vec3 &color);
+#endif
+  // mesh with up to levels coarser levels of detail, halving the number of
+  // segments for each level; the plane is flat, so every level has no
+  // geometric error
+  static std::shared_ptr<Mesh> generateLods(float width, float height,
+                                            UpAxis up, int widthSegments,
+                                            int heightSegments, int levels);
 };
 
 #endif
@@ -1,84 +1,165 @@
 #include "mesh_sphere.hpp"
-#include "main.hpp"
+#include "job_system.hpp"
+#include <algorithm>
 #include <cmath>
 #include <numbers>
+#include <vector>
 
-static void build(float radius, [[maybe_unused]] const glm::vec2 &uv,
-                  int longitudinalSegments, int latitudinalSegments,
-                  Mesh &mesh) {
-  // TODO:
-  // 以下のアルゴリズムだと、上部と下部において、面積が0のTriangleができてしまう。
-  // なので、頂点は追加するが、インデックスには追加しない頂点がある。
-  // このため、頂点のチェックを有効にするととエラーになる。
-  for (int latNumber = 0; latNumber <= latitudinalSegments;
-       ++latNumber) { // 高さ方向
-    for (int longNumber = 0; longNumber <= longitudinalSegments;
-         ++longNumber) { // 円周方向
-      float theta = latNumber * std::numbers::pi_v<float> / latitudinalSegments;
-      float phi =
-          longNumber * 2.0f * std::numbers::pi_v<float> / longitudinalSegments;
+// rings per job when the sphere is generated in parallel
+static constexpr std::size_t RINGS_PER_JOB = 16;
 
-      float sinTheta = std::sin(theta);
-      float sinPhi = std::sin(phi);
-      float cosTheta = std::cos(theta);
-      float cosPhi = std::cos(phi);
+/**
+ * 球のメッシュを作る。
+ * 極は1頂点ずつ、その間の各リングはlongitudinalSegments頂点で、継ぎ目の頂点は
+ * 共有するので、重複する頂点や面積が0の三角形はできない。
+ * 三角関数はリングと経度ごとに一度だけ計算し、頂点とインデックスは事前に
+ * 確保した配列に直接書き込む。jobsがあれば、リングごとに並列に書き込む。
+ */
+static std::shared_ptr<Mesh> build(float radius, int longitudinalSegments,
+                                   int latitudinalSegments, JobSystem *jobs) {
+  longitudinalSegments = std::max(longitudinalSegments, 3);
+  latitudinalSegments = std::max(latitudinalSegments, 2);
+  const std::size_t segments = longitudinalSegments;
+  // 極を除いたリングの数
+  const std::size_t rings = latitudinalSegments - 1;
 
-      float x = cosPhi * sinTheta;
-      float y = cosTheta;
-      float z = sinPhi * sinTheta;
-
-      //      NSLog(@"lat = %d, long = %d, (%g, %g, %g)", latNumber, longNumber,
-      //      x, y, z);
-      Vertex vertex;
-      vertex.position.x = radius * x;
-      vertex.position.y = radius * y;
-      vertex.position.z = radius * z;
-
-      vertex.normal.x = x;
-      vertex.normal.y = y;
-      vertex.normal.z = z;
-
-      mesh.addVertex(vertex);
-    }
+  // 円周方向 (経度) の三角関数
+  std::vector<float> sinPhi(segments);
+  std::vector<float> cosPhi(segments);
+  for (std::size_t s = 0; s < segments; ++s) {
+    float phi = s * 2.0f * std::numbers::pi_v<float> / longitudinalSegments;
+    sinPhi[s] = std::sin(phi);
+    cosPhi[s] = std::cos(phi);
+  }
+  // 高さ方向 (緯度) の三角関数
+  std::vector<float> sinTheta(rings);
+  std::vector<float> cosTheta(rings);
+  for (std::size_t r = 0; r < rings; ++r) {
+    int latNumber = static_cast<int>(r) + 1;
+    // 南半球は北半球を反転して求め、赤道に対して対称にする
+    bool south = latNumber * 2 > latitudinalSegments;
+    int mirrored = south ? latitudinalSegments - latNumber : latNumber;
+    float theta = mirrored * std::numbers::pi_v<float> / latitudinalSegments;
+    sinTheta[r] = std::sin(theta);
+    cosTheta[r] = south ? -std::cos(theta) : std::cos(theta);
   }
 
-  for (int latNumber = 0; latNumber < latitudinalSegments; ++latNumber) {
-    for (int longNumber = 0; longNumber < longitudinalSegments; ++longNumber) {
-
-      int first = (latNumber * (longitudinalSegments + 1)) + longNumber;
-      int second = first + (longitudinalSegments + 1);
-      int third = first + 1;
-      int fourth = second + 1;
+  // 北極、リング、南極の順
+  std::vector<Vertex> vertices(rings * segments + 2);
+  const IndexType northPole = 0;
+  const IndexType southPole = static_cast<IndexType>(vertices.size() - 1);
+  vertices[northPole] = {.position = {0.0f, radius, 0.0f},
+                         .normal = {0.0f, 1.0f, 0.0f},
+                         .color = glm::vec3(1.0f)};
+  vertices[southPole] = {.position = {0.0f, -radius, 0.0f},
+                         .normal = {0.0f, -1.0f, 0.0f},
+                         .color = glm::vec3(1.0f)};
 
-      // 上部以外の場合は、インデックスを追加する（上部の場合は面積が0の三角形になるので除く）
-      if (latNumber != 0) {
-        mesh.addIndex(first);
-        mesh.addIndex(third);
-        mesh.addIndex(second);
+  auto writeRings = [&](std::size_t begin, std::size_t end) {
+    for (std::size_t r = begin; r < end; ++r) {
+      Vertex *ring = vertices.data() + 1 + r * segments;
+      const float y = cosTheta[r];
+      const float sinT = sinTheta[r];
+      for (std::size_t s = 0; s < segments; ++s) {
+        float x = cosPhi[s] * sinT;
+        float z = sinPhi[s] * sinT;
+        ring[s].position = {radius * x, radius * y, radius * z};
+        ring[s].normal = {x, y, z};
+        ring[s].color = glm::vec3(1.0f);
       }
+    }
+  };
+
+  // 極に接する帯は三角形1つ、それ以外の帯は2つ (四角形) を経度ごとに持つ
+  std::vector<IndexType> indices(6 * segments * rings);
+  auto ringStart = [&](std::size_t r) {
+    return static_cast<IndexType>(1 + r * segments);
+  };
+  auto writeBands = [&](std::size_t begin, std::size_t end) {
+    for (std::size_t band = begin; band < end; ++band) {
+      IndexType *out =
+          indices.data() + (band == 0 ? 0 : 3 * segments * (2 * band - 1));
+      for (std::size_t s = 0; s < segments; ++s) {
+        // 継ぎ目では最初の列に戻る
+        std::size_t next = s + 1 < segments ? s + 1 : 0;
+        if (band == 0) {
+          IndexType below = ringStart(0);
+          *out++ = below + s;
+          *out++ = northPole;
+          *out++ = below + next;
+        } else if (band == rings) {
+          IndexType above = ringStart(rings - 1);
+          *out++ = above + s;
+          *out++ = above + next;
+          *out++ = southPole;
+        } else {
+          IndexType above = ringStart(band - 1);
+          IndexType below = above + segments;
+          *out++ = above + s;
+          *out++ = above + next;
+          *out++ = below + s;
 
-      // 下部以外の場合は、インデックスを追加する（下部の場合は面積が0の三角形になるので除く）
-      if (latNumber != (latitudinalSegments - 1)) {
-        mesh.addIndex(second);
-        mesh.addIndex(third);
-        mesh.addIndex(fourth);
+          *out++ = below + s;
+          *out++ = above + next;
+          *out++ = below + next;
+        }
       }
     }
+  };
+
+  if (jobs != nullptr) {
+    jobs->parallelFor(rings, RINGS_PER_JOB, writeRings);
+    jobs->parallelFor(rings + 1, RINGS_PER_JOB, writeBands);
+  } else {
+    writeRings(0, rings);
+    writeBands(0, rings + 1);
   }
+
+  return std::make_shared<Mesh>(std::move(vertices), std::move(indices));
 }
 
 std::shared_ptr<Mesh> Sphere::generate(float radius, int longitudinalSegments,
-                                       int latitudinalSegments) {
-  auto mesh = std::make_shared<Mesh>();
-  build(radius, {-1.0f, -1.0f}, longitudinalSegments, latitudinalSegments,
-        *mesh);
-  return mesh;
+                                       int latitudinalSegments,
+                                       JobSystem *jobs) {
+  return build(radius, longitudinalSegments, latitudinalSegments, jobs);
 }
 
+#if defined(SCENEGRAPH_VERTEX_COLOR)
 std::shared_ptr<Mesh> Sphere::generate(float radius, int longitudinalSegments,
                                        int latitudinalSegments,
                                        const glm::vec3 &color) {
-  auto mesh = std::make_shared<Mesh>();
-  build(radius, color, longitudinalSegments, latitudinalSegments, *mesh);
+  auto mesh = build(radius, longitudinalSegments, latitudinalSegments, nullptr);
+  mesh->setColor(color);
+  return mesh;
+}
+#endif
+
+/**
+ * 分割による球面からのずれ (弦と弧の最大距離)
+ */
+static float tessellationError(float radius, int longitudinalSegments,
+                               int latitudinalSegments) {
+  float longitudinal =
+      1.0f - std::cos(std::numbers::pi_v<float> / longitudinalSegments);
+  float latitudinal =
+      1.0f - std::cos(std::numbers::pi_v<float> / (2 * latitudinalSegments));
+  return radius * std::max(longitudinal, latitudinal);
+}
+
+std::shared_ptr<Mesh> Sphere::generateLods(float radius,
+                                           int longitudinalSegments,
+                                           int latitudinalSegments,
+                                           int levels) {
+  auto mesh = generate(radius, longitudinalSegments, latitudinalSegments);
+  for (int level = 0; level < levels; ++level) {
+    longitudinalSegments /= 2;
+    latitudinalSegments /= 2;
+    if (longitudinalSegments < 3 || latitudinalSegments < 2) {
+      break;
+    }
+    mesh->addLod(
+        generate(radius, longitudinalSegments, latitudinalSegments),
+        tessellationError(radius, longitudinalSegments, latitudinalSegments));
+  }
   return mesh;
 }
@@ -7,13 +7,26 @@
 
 #include <array>
 
+class JobSystem;
+
 class Sphere {
 public:
+  // with jobs, large spheres are generated on several threads
   static std::shared_ptr<Mesh> generate(float radius, int longitudinalSegments,
-                                        int latitudinalSegments);
+                                        int latitudinalSegments,
+                                        JobSystem *jobs = nullptr);
+#if defined(SCENEGRAPH_VERTEX_COLOR)
+  // with vertex colours only, see Mesh::setColor()
   static std::shared_ptr<Mesh> generate(float radius, int longitudinalSegments,
                                         int latitudinalSegments,
                                         const glm::vec3 &color);
+#endif
+  // mesh with up to levels coarser levels of detail, halving the number of
+  // segments for each level
+  static std::shared_ptr<Mesh> generateLods(float radius,
+                                            int longitudinalSegments,
+                                            int latitudinalSegments,
+                                            int levels);
 };
 
 #endif
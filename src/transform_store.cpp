@@ -0,0 +1,262 @@
+#include "transform_store.hpp"
+#include "job_system.hpp"
+
+#include <algorithm>
+#include <cassert>
+
+static glm::mat4 composeMatrix(const glm::vec3 &pos, const glm::quat &quat) {
+  glm::mat4 matrix = glm::mat4_cast(quat);
+  matrix[3][0] = pos.x;
+  matrix[3][1] = pos.y;
+  matrix[3][2] = pos.z;
+  matrix[3][3] = 1.0f;
+  return matrix;
+}
+
+template <typename T>
+static void permute(std::vector<T> &values,
+                    const std::vector<uint32_t> &order) {
+  std::vector<T> sorted;
+  sorted.reserve(values.size());
+  for (auto index : order) {
+    sorted.push_back(values[index]);
+  }
+  values.swap(sorted);
+}
+
+template <typename T>
+static void moveLastTo(std::vector<T> &values, uint32_t index) {
+  values[index] = values.back();
+  values.pop_back();
+}
+
+const std::shared_ptr<TransformStore> &TransformStore::defaultStore() {
+  static const std::shared_ptr<TransformStore> store =
+      std::make_shared<TransformStore>();
+  return store;
+}
+
+TransformStore::Handle TransformStore::create() {
+  Handle handle;
+  if (!m_freeHandles.empty()) {
+    handle = m_freeHandles.back();
+    m_freeHandles.pop_back();
+  } else {
+    handle = static_cast<Handle>(m_indices.size());
+    m_indices.push_back(InvalidIndex);
+  }
+
+  // A new transform is a root. Appending it keeps parents before children,
+  // and since it has no parent it can be updated with the last level rather
+  // than with the other roots, so no reordering is needed.
+  m_indices[handle] = static_cast<uint32_t>(m_positions.size());
+  m_positions.emplace_back(0.0f, 0.0f, 0.0f);
+  m_quats.emplace_back(glm::vec3{0.0f, 0.0f, 0.0f});
+  m_parents.push_back(InvalidIndex);
+  m_parentHandles.push_back(InvalidHandle);
+  m_depths.push_back(0);
+  m_localMatrices.emplace_back(1.0f);
+  m_worldMatrices.emplace_back(1.0f);
+  m_localDirty.push_back(0);
+  m_worldUpdates.push_back(0);
+  m_handles.push_back(handle);
+  if (m_levelOffsets.size() < 2) {
+    m_levelOffsets = {0, 0};
+  }
+  m_levelOffsets.back() = static_cast<uint32_t>(m_positions.size());
+  markDirty(m_indices[handle]);
+  return handle;
+}
+
+void TransformStore::destroy(Handle handle) {
+  uint32_t index = m_indices[handle];
+  assert(index != InvalidIndex);
+
+  // swap-remove; the moved transform may now precede its parent
+  moveLastTo(m_positions, index);
+  moveLastTo(m_quats, index);
+  moveLastTo(m_parents, index);
+  moveLastTo(m_parentHandles, index);
+  moveLastTo(m_depths, index);
+  moveLastTo(m_localMatrices, index);
+  moveLastTo(m_worldMatrices, index);
+  moveLastTo(m_localDirty, index);
+  moveLastTo(m_worldUpdates, index);
+  moveLastTo(m_handles, index);
+  if (index < m_handles.size()) {
+    m_indices[m_handles[index]] = index;
+  }
+
+  m_indices[handle] = InvalidIndex;
+  m_pendingFreeHandles.push_back(handle);
+  m_needsSort = true;
+}
+
+void TransformStore::setParent(Handle handle, Handle parent) {
+  uint32_t index = m_indices[handle];
+  m_parentHandles[index] = parent;
+  markDirty(index);
+
+  // the arrays stay valid only if the transform keeps its depth and its
+  // parent precedes it; otherwise reorder on the next update()
+  uint32_t parentIndex = InvalidIndex;
+  uint32_t depth = 0;
+  if (parent != InvalidHandle) {
+    parentIndex = m_indices[parent];
+    depth = m_depths[parentIndex] + 1;
+  }
+  m_parents[index] = parentIndex;
+  if (depth != m_depths[index] ||
+      (parentIndex != InvalidIndex && parentIndex > index)) {
+    m_needsSort = true;
+  }
+}
+
+glm::mat4 TransformStore::localMatrix(Handle handle) const {
+  uint32_t index = m_indices[handle];
+  return composeMatrix(m_positions[index], m_quats[index]);
+}
+
+void TransformStore::update(JobSystem *jobs) {
+  if (m_needsSort) {
+    sort();
+  }
+  if (m_firstDirty == InvalidIndex) {
+    return;
+  }
+
+  // transforms before m_firstDirty and their parents are all clean
+  ++m_updateCount;
+  m_changedHandles.clear();
+  if (jobs == nullptr || jobs->threadCount() == 1) {
+    updateRange(m_firstDirty, m_positions.size(), m_changedHandles);
+  } else {
+    for (std::size_t level = 0; level + 1 < m_levelOffsets.size(); ++level) {
+      std::size_t begin = std::max(m_levelOffsets[level], m_firstDirty);
+      std::size_t end = m_levelOffsets[level + 1];
+      if (begin >= end) {
+        continue;
+      }
+      // the ranges of parallelFor() start at multiples of the grain size
+      std::size_t jobCount =
+          (end - begin + ParallelGrainSize - 1) / ParallelGrainSize;
+      if (m_changedPerJob.size() < jobCount) {
+        m_changedPerJob.resize(jobCount);
+      }
+      jobs->parallelFor(end - begin, ParallelGrainSize,
+                        [this, begin](std::size_t first, std::size_t last) {
+                          updateRange(begin + first, begin + last,
+                                      m_changedPerJob[first /
+                                                      ParallelGrainSize]);
+                        });
+      for (std::size_t j = 0; j < jobCount; ++j) {
+        m_changedHandles.insert(m_changedHandles.end(),
+                                m_changedPerJob[j].begin(),
+                                m_changedPerJob[j].end());
+        m_changedPerJob[j].clear();
+      }
+    }
+  }
+  m_firstDirty = InvalidIndex;
+}
+
+void TransformStore::updateRange(std::size_t begin, std::size_t end,
+                                 std::vector<Handle> &changed) {
+  for (std::size_t i = begin; i < end; ++i) {
+    uint32_t parent = m_parents[i];
+    bool parentChanged =
+        parent != InvalidIndex && m_worldUpdates[parent] == m_updateCount;
+    if (!m_localDirty[i] && !parentChanged) {
+      continue;
+    }
+    if (m_localDirty[i]) {
+      m_localMatrices[i] = composeMatrix(m_positions[i], m_quats[i]);
+      m_localDirty[i] = 0;
+    }
+    m_worldMatrices[i] = parent == InvalidIndex
+                             ? m_localMatrices[i]
+                             : m_worldMatrices[parent] * m_localMatrices[i];
+    m_worldUpdates[i] = m_updateCount;
+    changed.push_back(m_handles[i]);
+  }
+}
+
+void TransformStore::sort() {
+  const uint32_t count = static_cast<uint32_t>(m_positions.size());
+
+  // children of destroyed transforms become roots
+  for (uint32_t i = 0; i < count; ++i) {
+    Handle parent = m_parentHandles[i];
+    if (parent != InvalidHandle && m_indices[parent] == InvalidIndex) {
+      m_parentHandles[i] = InvalidHandle;
+      m_localDirty[i] = 1;
+    }
+  }
+
+  // depth of every transform
+  std::vector<uint32_t> depths(count, InvalidIndex);
+  std::vector<uint32_t> chain;
+  uint32_t maxDepth = 0;
+  for (uint32_t i = 0; i < count; ++i) {
+    uint32_t j = i;
+    while (depths[j] == InvalidIndex && m_parentHandles[j] != InvalidHandle) {
+      chain.push_back(j);
+      j = m_indices[m_parentHandles[j]];
+    }
+    if (depths[j] == InvalidIndex) {
+      depths[j] = 0;
+    }
+    uint32_t depth = depths[j];
+    while (!chain.empty()) {
+      depths[chain.back()] = ++depth;
+      chain.pop_back();
+    }
+    maxDepth = std::max(maxDepth, depth);
+  }
+
+  // stable counting sort by depth
+  std::vector<uint32_t> offsets(maxDepth + 2, 0);
+  for (auto depth : depths) {
+    ++offsets[depth + 1];
+  }
+  for (std::size_t d = 1; d < offsets.size(); ++d) {
+    offsets[d] += offsets[d - 1];
+  }
+  m_levelOffsets = offsets;
+  std::vector<uint32_t> order(count);
+  for (uint32_t i = 0; i < count; ++i) {
+    order[offsets[depths[i]]++] = i;
+  }
+
+  permute(m_positions, order);
+  permute(m_quats, order);
+  permute(m_parentHandles, order);
+  permute(depths, order);
+  m_depths.swap(depths);
+  permute(m_localMatrices, order);
+  permute(m_worldMatrices, order);
+  permute(m_localDirty, order);
+  permute(m_worldUpdates, order);
+  permute(m_handles, order);
+
+  for (uint32_t i = 0; i < count; ++i) {
+    m_indices[m_handles[i]] = i;
+  }
+  for (uint32_t i = 0; i < count; ++i) {
+    Handle parent = m_parentHandles[i];
+    m_parents[i] = parent == InvalidHandle ? InvalidIndex : m_indices[parent];
+  }
+
+  m_freeHandles.insert(m_freeHandles.end(), m_pendingFreeHandles.begin(),
+                       m_pendingFreeHandles.end());
+  m_pendingFreeHandles.clear();
+
+  m_firstDirty = InvalidIndex;
+  for (uint32_t i = 0; i < count; ++i) {
+    if (m_localDirty[i]) {
+      m_firstDirty = i;
+      break;
+    }
+  }
+  m_needsSort = false;
+}
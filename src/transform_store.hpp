@@ -0,0 +1,143 @@
+#ifndef __TRANSFORM_STORE_HPP__
+#define __TRANSFORM_STORE_HPP__
+
+#include "common.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <vector>
+
+class JobSystem;
+
+/**
+ * Structure-of-arrays storage for node transforms.
+ *
+ * Transforms are addressed by stable handles. Internally the arrays are kept
+ * sorted so that a parent always precedes its children, which lets update()
+ * compute every world matrix in a single linear sweep.
+ *
+ * Setting a position, rotation or parent marks the local matrix dirty. A
+ * world matrix is recomputed only when its local matrix is dirty or its
+ * parent's world matrix changed in the same sweep, so static subtrees are
+ * skipped, and the sweep starts at the first dirty transform.
+ *
+ * Transforms are grouped by depth, so with a JobSystem each depth level is
+ * updated in parallel once the level above it is complete. New transforms
+ * are roots and join the last level until the next reordering.
+ *
+ * The handles whose world matrix changed are recorded, so that structures
+ * derived from world matrices can be brought up to date in proportion to
+ * the number of changes rather than the number of transforms.
+ */
+class TransformStore {
+public:
+  using Handle = uint32_t;
+  static constexpr Handle InvalidHandle = std::numeric_limits<Handle>::max();
+
+  // store used by nodes that are not given one explicitly
+  static const std::shared_ptr<TransformStore> &defaultStore();
+
+  Handle create();
+  void destroy(Handle handle);
+
+  // parent
+  void setParent(Handle handle, Handle parent);
+  Handle parent(Handle handle) const {
+    return m_parentHandles[m_indices[handle]];
+  }
+
+  // position
+  void setPosition(Handle handle, const glm::vec3 &pos) {
+    uint32_t index = m_indices[handle];
+    m_positions[index] = pos;
+    markDirty(index);
+  }
+  const glm::vec3 &position(Handle handle) const {
+    return m_positions[m_indices[handle]];
+  }
+
+  // quat
+  void setQuat(Handle handle, const glm::quat &quat) {
+    uint32_t index = m_indices[handle];
+    m_quats[index] = quat;
+    markDirty(index);
+  }
+  const glm::quat &quat(Handle handle) const {
+    return m_quats[m_indices[handle]];
+  }
+
+  glm::mat4 localMatrix(Handle handle) const;
+
+  // world matrix as of the last update()
+  const glm::mat4 &worldMatrix(Handle handle) const {
+    return m_worldMatrices[m_indices[handle]];
+  }
+
+  // recompute the world matrices of dirty transforms and their descendants
+  void update(JobSystem *jobs = nullptr);
+
+  // true if update() has work to do
+  bool isDirty() const {
+    return m_needsSort || m_firstDirty != InvalidIndex;
+  }
+
+  // number of update() calls that recomputed world matrices
+  uint32_t updateCount() const { return m_updateCount; }
+  // handles whose world matrix changed in update number updateCount(),
+  // parents before children
+  const std::vector<Handle> &changedHandles() const {
+    return m_changedHandles;
+  }
+
+  std::size_t size() const { return m_positions.size(); }
+
+private:
+  static constexpr uint32_t InvalidIndex = std::numeric_limits<uint32_t>::max();
+  // transforms per job when a level is updated in parallel
+  static constexpr std::size_t ParallelGrainSize = 1024;
+
+  void markDirty(uint32_t index) {
+    m_localDirty[index] = 1;
+    m_firstDirty = std::min(m_firstDirty, index);
+  }
+
+  // reorder the arrays by depth so that parents precede their children
+  void sort();
+
+  void updateRange(std::size_t begin, std::size_t end,
+                   std::vector<Handle> &changed);
+
+  // dense arrays, ordered parent-before-child
+  std::vector<glm::vec3> m_positions;
+  std::vector<glm::quat> m_quats;
+  std::vector<uint32_t> m_parents; // dense index of the parent
+  std::vector<Handle> m_parentHandles;
+  std::vector<uint32_t> m_depths;
+  std::vector<glm::mat4> m_localMatrices;
+  std::vector<glm::mat4> m_worldMatrices;
+  std::vector<uint8_t> m_localDirty;
+  // update pass in which the world matrix last changed
+  std::vector<uint32_t> m_worldUpdates;
+  std::vector<Handle> m_handles; // dense index -> handle
+  // first dense index of each depth, followed by size(); the last level
+  // also holds the roots created since the last sort()
+  std::vector<uint32_t> m_levelOffsets;
+
+  // handle -> dense index
+  std::vector<uint32_t> m_indices;
+  std::vector<Handle> m_freeHandles;
+  // destroyed handles, recycled once no parent link can refer to them
+  std::vector<Handle> m_pendingFreeHandles;
+
+  uint32_t m_updateCount = 0;
+  std::vector<Handle> m_changedHandles;
+  // changes of each parallel job of a level, merged in order afterwards
+  std::vector<std::vector<Handle>> m_changedPerJob;
+  // smallest dense index with a dirty local matrix
+  uint32_t m_firstDirty = InvalidIndex;
+  bool m_needsSort = false;
+};
+
+#endif
@@ -1 +1,30 @@
-#include "types.hpp"
\ No newline at end of file
+#include "types.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+float maxAxisScale(const glm::mat4 &matrix) {
+  glm::vec3 x(matrix[0]), y(matrix[1]), z(matrix[2]);
+  return std::sqrt(
+      std::max({glm::dot(x, x), glm::dot(y, y), glm::dot(z, z)}));
+}
+
+BoundingSphere transformBounds(const BoundingSphere &sphere,
+                               const glm::mat4 &matrix) {
+  return {glm::vec3(matrix * glm::vec4(sphere.center, 1.0f)),
+          sphere.radius * maxAxisScale(matrix)};
+}
+
+BoundingBox transformBounds(const BoundingBox &box, const glm::mat4 &matrix) {
+  if (box.empty()) {
+    return box;
+  }
+  // the extents along each world axis are the absolute values of the
+  // rotated and scaled local extents (Arvo)
+  glm::vec3 center = glm::vec3(matrix * glm::vec4(box.center(), 1.0f));
+  glm::vec3 local = box.extents();
+  glm::vec3 extents = glm::abs(glm::vec3(matrix[0])) * local.x +
+                      glm::abs(glm::vec3(matrix[1])) * local.y +
+                      glm::abs(glm::vec3(matrix[2])) * local.z;
+  return {center - extents, center + extents};
+}
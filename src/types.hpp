@@ -3,6 +3,8 @@
 
 #include "common.hpp"
 
+#include <limits>
+
 struct Vertex {
   glm::vec3 position;
   glm::vec3 normal;
@@ -11,6 +13,41 @@ struct Vertex {
 
 using IndexType = uint32_t;
 
+// sphere enclosing a set of points
+struct BoundingSphere {
+  glm::vec3 center{0.0f};
+  float radius = 0.0f;
+};
+
+// axis-aligned box enclosing a set of points; empty until a point is added
+struct BoundingBox {
+  glm::vec3 min{std::numeric_limits<float>::max()};
+  glm::vec3 max{std::numeric_limits<float>::lowest()};
+
+  bool empty() const { return min.x > max.x; }
+  glm::vec3 center() const { return (min + max) * 0.5f; }
+  // half the size along each axis
+  glm::vec3 extents() const { return (max - min) * 0.5f; }
+
+  void expand(const glm::vec3 &point) {
+    min = glm::min(min, point);
+    max = glm::max(max, point);
+  }
+  void expand(const BoundingBox &box) {
+    min = glm::min(min, box.min);
+    max = glm::max(max, box.max);
+  }
+};
+
+// largest factor by which matrix scales a length along one of its axes
+float maxAxisScale(const glm::mat4 &matrix);
+
+// bounds of a volume after transforming it by matrix; the sphere is scaled by
+// maxAxisScale(), the box encloses the transformed box
+BoundingSphere transformBounds(const BoundingSphere &sphere,
+                               const glm::mat4 &matrix);
+BoundingBox transformBounds(const BoundingBox &box, const glm::mat4 &matrix);
+
 enum class UpAxis { X, Y, Z };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,33 @@
+#include "uniforms.hpp"
+#include "job_system.hpp"
+#include "node.hpp"
+#include "transform_store.hpp"
+
+#include <cassert>
+
+// nodes per job
+static constexpr std::size_t GRAIN_SIZE = 512;
+
+void writeNodeUniforms(JobSystem &jobs, std::span<Node *const> nodes,
+                       NodeUniforms *dst) {
+  // Node::worldMatrix() would update a dirty store from several threads
+#ifndef NDEBUG
+  for (Node *node : nodes) {
+    assert(!node->transformStore()->isDirty());
+  }
+#endif
+  jobs.parallelFor(nodes.size(), GRAIN_SIZE,
+                   [&](std::size_t begin, std::size_t end) {
+                     for (std::size_t i = begin; i < end; ++i) {
+                       const Node &node = *nodes[i];
+                       const glm::mat4 &m = node.transformStore()->worldMatrix(
+                           node.transformHandle());
+                       NodeUniforms &out = dst[i];
+                       for (int r = 0; r < 3; ++r) {
+                         out.rows[r] = glm::vec4(m[0][r], m[1][r], m[2][r],
+                                                 m[3][r]);
+                       }
+                       out.color = node.color();
+                     }
+                   });
+}
@@ -0,0 +1,41 @@
+#ifndef __UNIFORMS_HPP__
+#define __UNIFORMS_HPP__
+
+#include "common.hpp"
+
+#include <cstddef>
+#include <span>
+
+class JobSystem;
+class Node;
+
+// per-frame camera data, see shaders/triangle.vert
+struct CameraUniforms {
+  glm::mat4 view;
+  glm::mat4 proj;
+  glm::mat4 viewProj;
+  glm::vec4 light;
+};
+
+/**
+ * Per-node data, see shaders/triangle.vert.
+ *
+ * The upper 3x4 part of the world matrix, stored row by row so that it maps
+ * to a mat3x4 in a std430 buffer, followed by the colour of the node.
+ */
+struct NodeUniforms {
+  glm::vec4 rows[3];
+  glm::vec4 color;
+};
+
+static_assert(sizeof(NodeUniforms) == 64);
+
+/**
+ * Write the NodeUniforms of every node to dst, splitting the nodes across the
+ * threads of jobs. The transform stores of the nodes must have been updated;
+ * the world matrices are read as they are.
+ */
+void writeNodeUniforms(JobSystem &jobs, std::span<Node *const> nodes,
+                       NodeUniforms *dst);
+
+#endif
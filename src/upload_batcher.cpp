@@ -0,0 +1,234 @@
+#include "upload_batcher.hpp"
+
+#include <vulkan/vk_enum_string_helper.h>
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+// ring positions are aligned so that any element type can be copied
+static constexpr VkDeviceSize STAGING_ALIGNMENT = 16;
+
+UploadBatcher::UploadBatcher(VkDevice device, VmaAllocator allocator,
+                             VkQueue queue, uint32_t queueFamilyIndex,
+                             uint32_t dstQueueFamilyIndex,
+                             VkDeviceSize stagingSize)
+    : m_device(device), m_allocator(allocator), m_queue(queue),
+      m_queueFamilyIndex(queueFamilyIndex),
+      m_dstQueueFamilyIndex(dstQueueFamilyIndex) {
+  VkCommandPoolCreateInfo poolInfo{
+      .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+      .flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT |
+               VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT,
+      .queueFamilyIndex = queueFamilyIndex};
+  VK_CHECK(vkCreateCommandPool(m_device, &poolInfo, nullptr, &m_commandPool));
+
+  VkSemaphoreTypeCreateInfo typeInfo{
+      .sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO,
+      .semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE,
+      .initialValue = 0};
+  VkSemaphoreCreateInfo semaphoreInfo{
+      .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO, .pNext = &typeInfo};
+  VK_CHECK(vkCreateSemaphore(m_device, &semaphoreInfo, nullptr, &m_semaphore));
+
+  m_stagingSize =
+      (stagingSize + STAGING_ALIGNMENT - 1) & ~(STAGING_ALIGNMENT - 1);
+  VkBufferCreateInfo bufferInfo{};
+  bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+  bufferInfo.size = m_stagingSize;
+  bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+  bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+  VmaAllocationCreateInfo allocationCreateInfo{};
+  allocationCreateInfo.flags =
+      VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT |
+      VMA_ALLOCATION_CREATE_MAPPED_BIT;
+  allocationCreateInfo.usage = VMA_MEMORY_USAGE_AUTO;
+
+  VmaAllocationInfo allocationInfo{};
+  VK_CHECK(vmaCreateBuffer(m_allocator, &bufferInfo, &allocationCreateInfo,
+                           &m_stagingBuffer, &m_stagingAllocation,
+                           &allocationInfo));
+  m_stagingMapped = static_cast<std::byte *>(allocationInfo.pMappedData);
+}
+
+UploadBatcher::~UploadBatcher() {
+  if (!m_inFlight.empty()) {
+    wait(m_inFlight.back().value);
+  }
+  // also frees the command buffers
+  vkDestroyCommandPool(m_device, m_commandPool, nullptr);
+  vkDestroySemaphore(m_device, m_semaphore, nullptr);
+  vmaDestroyBuffer(m_allocator, m_stagingBuffer, m_stagingAllocation);
+}
+
+void UploadBatcher::copyToBuffer(VkBuffer dst, VkDeviceSize dstOffset,
+                                 const void *data, VkDeviceSize size) {
+  const auto *src = static_cast<const std::byte *>(data);
+  // larger copies are split so that every chunk fits into the ring
+  const VkDeviceSize maxChunkSize = m_stagingSize / 2;
+  while (size > 0) {
+    VkDeviceSize chunkSize = std::min(size, maxChunkSize);
+    VkDeviceSize offset = reserve(chunkSize);
+    std::memcpy(m_stagingMapped + offset, src, chunkSize);
+
+    if (m_recording.commandBuffer == VK_NULL_HANDLE) {
+      if (m_freeCommandBuffers.empty()) {
+        VkCommandBufferAllocateInfo allocInfo{
+            .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+            .commandPool = m_commandPool,
+            .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+            .commandBufferCount = 1};
+        VK_CHECK(vkAllocateCommandBuffers(m_device, &allocInfo,
+                                          &m_recording.commandBuffer));
+      } else {
+        m_recording.commandBuffer = m_freeCommandBuffers.back();
+        m_freeCommandBuffers.pop_back();
+      }
+      VkCommandBufferBeginInfo beginInfo{
+          .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+          .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT};
+      VK_CHECK(vkBeginCommandBuffer(m_recording.commandBuffer, &beginInfo));
+    }
+
+    VkBufferCopy region{
+        .srcOffset = offset, .dstOffset = dstOffset, .size = chunkSize};
+    vkCmdCopyBuffer(m_recording.commandBuffer, m_stagingBuffer, dst, 1,
+                    &region);
+    m_recording.stagingEnd = m_head;
+
+    if (m_queueFamilyIndex != m_dstQueueFamilyIndex) {
+      // consecutive ranges of a buffer are released by one barrier
+      if (!m_releases.empty() && m_releases.back().buffer == dst &&
+          m_releases.back().offset + m_releases.back().size == dstOffset) {
+        m_releases.back().size += chunkSize;
+      } else {
+        m_releases.push_back(
+            {.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2,
+             .srcStageMask = VK_PIPELINE_STAGE_2_COPY_BIT,
+             .srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT,
+             .dstStageMask = VK_PIPELINE_STAGE_2_NONE,
+             .dstAccessMask = VK_ACCESS_2_NONE,
+             .srcQueueFamilyIndex = m_queueFamilyIndex,
+             .dstQueueFamilyIndex = m_dstQueueFamilyIndex,
+             .buffer = dst,
+             .offset = dstOffset,
+             .size = chunkSize});
+      }
+    }
+
+    src += chunkSize;
+    dstOffset += chunkSize;
+    size -= chunkSize;
+  }
+}
+
+uint64_t UploadBatcher::submit() {
+  if (m_recording.commandBuffer == VK_NULL_HANDLE) {
+    return m_submittedValue;
+  }
+  if (!m_releases.empty()) {
+    VkDependencyInfo dependencyInfo{
+        .sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO,
+        .bufferMemoryBarrierCount = static_cast<uint32_t>(m_releases.size()),
+        .pBufferMemoryBarriers = m_releases.data()};
+    vkCmdPipelineBarrier2(m_recording.commandBuffer, &dependencyInfo);
+    m_pendingAcquires.insert(m_pendingAcquires.end(), m_releases.begin(),
+                             m_releases.end());
+    m_releases.clear();
+  }
+  VK_CHECK(vkEndCommandBuffer(m_recording.commandBuffer));
+  // no-op unless the staging memory is not host coherent
+  VK_CHECK(vmaFlushAllocation(m_allocator, m_stagingAllocation, 0,
+                              VK_WHOLE_SIZE));
+
+  m_recording.value = m_submittedValue + 1;
+  VkTimelineSemaphoreSubmitInfo timelineInfo{
+      .sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO,
+      .signalSemaphoreValueCount = 1,
+      .pSignalSemaphoreValues = &m_recording.value};
+  VkSubmitInfo submitInfo{.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+                          .pNext = &timelineInfo,
+                          .commandBufferCount = 1,
+                          .pCommandBuffers = &m_recording.commandBuffer,
+                          .signalSemaphoreCount = 1,
+                          .pSignalSemaphores = &m_semaphore};
+  VK_CHECK(vkQueueSubmit(m_queue, 1, &submitInfo, VK_NULL_HANDLE));
+
+  m_submittedValue = m_recording.value;
+  m_inFlight.push_back(m_recording);
+  m_recording = {};
+  return m_submittedValue;
+}
+
+void UploadBatcher::wait(uint64_t value) {
+  if (value > m_submittedValue) {
+    submit();
+  }
+  VkSemaphoreWaitInfo waitInfo{.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO,
+                               .semaphoreCount = 1,
+                               .pSemaphores = &m_semaphore,
+                               .pValues = &value};
+  VK_CHECK(vkWaitSemaphores(m_device, &waitInfo,
+                            std::numeric_limits<uint64_t>::max()));
+  retire(value);
+}
+
+void UploadBatcher::collect() {
+  if (m_inFlight.empty()) {
+    return;
+  }
+  uint64_t completedValue = 0;
+  VK_CHECK(vkGetSemaphoreCounterValue(m_device, m_semaphore, &completedValue));
+  retire(completedValue);
+}
+
+std::vector<VkBufferMemoryBarrier2>
+UploadBatcher::acquireBarriers(VkPipelineStageFlags2 stage,
+                               VkAccessFlags2 access) {
+  std::vector<VkBufferMemoryBarrier2> acquires;
+  acquires.swap(m_pendingAcquires);
+  for (auto &barrier : acquires) {
+    // the source stage chains with the semaphore wait of the consumer
+    barrier.srcStageMask = stage;
+    barrier.srcAccessMask = VK_ACCESS_2_NONE;
+    barrier.dstStageMask = stage;
+    barrier.dstAccessMask = access;
+  }
+  return acquires;
+}
+
+VkDeviceSize UploadBatcher::reserve(VkDeviceSize size) {
+  uint64_t position =
+      (m_head + STAGING_ALIGNMENT - 1) & ~(STAGING_ALIGNMENT - 1);
+  VkDeviceSize offset = position % m_stagingSize;
+  if (offset + size > m_stagingSize) {
+    // does not fit before the end of the ring; continue at its beginning
+    position += m_stagingSize - offset;
+    offset = 0;
+  }
+  while (position + size - m_tail > m_stagingSize) {
+    // the ring is full; wait for the oldest batch, submitting the current
+    // one first if it holds the space
+    if (m_inFlight.empty()) {
+      submit();
+    }
+    if (m_inFlight.empty()) {
+      // nothing is recorded or in flight, so only the alignment and the
+      // skipped end of the ring are in the way and the whole ring is free
+      m_tail = position;
+      break;
+    }
+    wait(m_inFlight.front().value);
+  }
+  m_head = position + size;
+  return offset;
+}
+
+void UploadBatcher::retire(uint64_t completedValue) {
+  while (!m_inFlight.empty() && m_inFlight.front().value <= completedValue) {
+    m_tail = m_inFlight.front().stagingEnd;
+    m_freeCommandBuffers.push_back(m_inFlight.front().commandBuffer);
+    m_inFlight.pop_front();
+  }
+}
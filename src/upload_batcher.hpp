@@ -0,0 +1,101 @@
+#ifndef __UPLOAD_BATCHER_HPP__
+#define __UPLOAD_BATCHER_HPP__
+
+#include "common.hpp"
+
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+/**
+ * Batches buffer uploads through a persistently mapped staging ring.
+ *
+ * copyToBuffer() copies the data into the ring and records a transfer into
+ * the command buffer of the current batch; nothing is submitted until
+ * submit(). Every submitted batch signals the next value of a timeline
+ * semaphore, so consumers can wait for the uploads on the GPU, and staging
+ * space and command buffers are reused once their batch has completed.
+ * The CPU only blocks when the ring is full.
+ *
+ * When the uploads run on a queue family other than the one that uses the
+ * data, every batch releases the written ranges to the consumer family, and
+ * the consumer records the matching acquires from acquireBarriers().
+ */
+class UploadBatcher {
+  struct Batch {
+    VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+    // timeline value signalled when the batch completes
+    uint64_t value = 0;
+    // ring position after the last byte used by the batch
+    uint64_t stagingEnd = 0;
+  };
+
+public:
+  // queue runs the copies; dstQueueFamilyIndex is the family that uses the
+  // uploaded buffers
+  UploadBatcher(VkDevice device, VmaAllocator allocator, VkQueue queue,
+                uint32_t queueFamilyIndex, uint32_t dstQueueFamilyIndex,
+                VkDeviceSize stagingSize);
+  ~UploadBatcher();
+
+  UploadBatcher(const UploadBatcher &) = delete;
+  UploadBatcher &operator=(const UploadBatcher &) = delete;
+
+  // copy size bytes of data to dst at dstOffset in the current batch
+  void copyToBuffer(VkBuffer dst, VkDeviceSize dstOffset, const void *data,
+                    VkDeviceSize size);
+
+  // submit the current batch, if any; returns the value that signals the
+  // completion of every upload recorded so far
+  uint64_t submit();
+
+  // value signalled by the last submitted batch
+  uint64_t submittedValue() const { return m_submittedValue; }
+  VkSemaphore semaphore() const { return m_semaphore; }
+
+  // block until the batch of value has completed
+  void wait(uint64_t value);
+
+  // recycle the staging space and command buffers of completed batches
+  void collect();
+
+  // acquire barriers for the ranges released by the batches submitted so
+  // far, to be recorded on the consumer queue before stage reads them; empty
+  // if both queues belong to the same family
+  std::vector<VkBufferMemoryBarrier2>
+  acquireBarriers(VkPipelineStageFlags2 stage, VkAccessFlags2 access);
+
+private:
+  // reserve size bytes of the ring; returns the offset in the ring buffer
+  VkDeviceSize reserve(VkDeviceSize size);
+  void retire(uint64_t completedValue);
+
+  VkDevice m_device;
+  VmaAllocator m_allocator;
+  VkQueue m_queue;
+  uint32_t m_queueFamilyIndex;
+  uint32_t m_dstQueueFamilyIndex;
+
+  VkCommandPool m_commandPool = VK_NULL_HANDLE;
+  VkSemaphore m_semaphore = VK_NULL_HANDLE;
+
+  VkBuffer m_stagingBuffer = VK_NULL_HANDLE;
+  VmaAllocation m_stagingAllocation = VK_NULL_HANDLE;
+  std::byte *m_stagingMapped = nullptr;
+  VkDeviceSize m_stagingSize = 0;
+  // monotonic ring positions; the physical offset is position % size
+  uint64_t m_head = 0;
+  uint64_t m_tail = 0;
+
+  // batch being recorded; commandBuffer is null if nothing is recorded
+  Batch m_recording;
+  std::deque<Batch> m_inFlight;
+  std::vector<VkCommandBuffer> m_freeCommandBuffers;
+  // ownership releases of the batch being recorded
+  std::vector<VkBufferMemoryBarrier2> m_releases;
+  // ranges released by submitted batches and not yet acquired
+  std::vector<VkBufferMemoryBarrier2> m_pendingAcquires;
+  uint64_t m_submittedValue = 0;
+};
+
+#endif
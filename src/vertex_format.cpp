@@ -0,0 +1,71 @@
+#include "vertex_format.hpp"
+#include "mesh.hpp"
+
+#include <glm/gtc/packing.hpp>
+
+#include <algorithm>
+#include <cmath>
+
+VertexEncoding<VertexLayout::Compact>::Position
+VertexEncoding<VertexLayout::Compact>::encodePosition(
+    const glm::vec3 &position) {
+  return {glm::packHalf1x16(position.x), glm::packHalf1x16(position.y),
+          glm::packHalf1x16(position.z), glm::packHalf1x16(1.0f)};
+}
+
+VertexEncoding<VertexLayout::Compact>::Normal
+VertexEncoding<VertexLayout::Compact>::encodeNormal(const glm::vec3 &normal) {
+  return glm::packSnorm2x16(octahedralEncode(normal));
+}
+
+VertexEncoding<VertexLayout::Compact>::Color
+VertexEncoding<VertexLayout::Compact>::encodeColor(const glm::vec3 &color) {
+  return glm::packUnorm4x8(glm::vec4(color, 1.0f));
+}
+
+glm::vec2 octahedralEncode(const glm::vec3 &normal) {
+  float l1 = std::abs(normal.x) + std::abs(normal.y) + std::abs(normal.z);
+  if (l1 == 0.0f) {
+    return glm::vec2(0.0f);
+  }
+  glm::vec2 p = glm::vec2(normal.x, normal.y) / l1;
+  if (normal.z < 0.0f) {
+    // fold the lower hemisphere over the diagonals
+    glm::vec2 folded(1.0f - std::abs(p.y), 1.0f - std::abs(p.x));
+    p.x = p.x >= 0.0f ? folded.x : -folded.x;
+    p.y = p.y >= 0.0f ? folded.y : -folded.y;
+  }
+  return p;
+}
+
+glm::vec3 octahedralDecode(const glm::vec2 &encoded) {
+  glm::vec3 n(encoded.x, encoded.y,
+              1.0f - std::abs(encoded.x) - std::abs(encoded.y));
+  float t = std::max(-n.z, 0.0f);
+  n.x += n.x >= 0.0f ? -t : t;
+  n.y += n.y >= 0.0f ? -t : t;
+  return glm::normalize(n);
+}
+
+void encodeVertices(std::span<const Vertex> vertices,
+                    std::vector<GpuVertex> &encoded) {
+  encoded.resize(vertices.size());
+  std::ranges::transform(vertices, encoded.begin(),
+                         ActiveVertexTraits::encode);
+}
+
+void narrowIndices(std::span<const IndexType> indices,
+                   std::vector<uint16_t> &narrowed) {
+  narrowed.assign(indices.begin(), indices.end());
+}
+
+GeometryUpload prepareGeometryUpload(const Mesh &lod, bool shortIndices,
+                                     std::vector<GpuVertex> &encoded,
+                                     std::vector<uint16_t> &narrowed) {
+  encodeVertices(lod.vertices(), encoded);
+  if (!shortIndices) {
+    return {encoded, std::as_bytes(lod.indices())};
+  }
+  narrowIndices(lod.indices(), narrowed);
+  return {encoded, std::as_bytes(std::span<const uint16_t>(narrowed))};
+}
@@ -0,0 +1,162 @@
+#ifndef __VERTEX_FORMAT_HPP__
+#define __VERTEX_FORMAT_HPP__
+
+#include "common.hpp"
+#include "types.hpp"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+class Mesh;
+
+// formats of the vertices stored in the GPU vertex buffer
+enum class VertexLayout {
+  // 32-bit floats, as in Vertex
+  Float,
+  // half-float position, octahedral snorm16 normal, RGBA8 colour
+  Compact,
+};
+
+// storage of the individual attributes of a layout
+template <VertexLayout Layout> struct VertexEncoding;
+
+template <> struct VertexEncoding<VertexLayout::Float> {
+  using Position = glm::vec3;
+  using Normal = glm::vec3;
+  using Color = glm::vec3;
+  static constexpr VkFormat positionFormat = VK_FORMAT_R32G32B32_SFLOAT;
+  static constexpr VkFormat normalFormat = VK_FORMAT_R32G32B32_SFLOAT;
+  static constexpr VkFormat colorFormat = VK_FORMAT_R32G32B32_SFLOAT;
+
+  static Position encodePosition(const glm::vec3 &position) {
+    return position;
+  }
+  static Normal encodeNormal(const glm::vec3 &normal) { return normal; }
+  static Color encodeColor(const glm::vec3 &color) { return color; }
+};
+
+template <> struct VertexEncoding<VertexLayout::Compact> {
+  using Position = std::array<uint16_t, 4>; // 4 x float16, w unused
+  using Normal = uint32_t;                  // octahedral, 2 x snorm16
+  using Color = uint32_t;                   // RGBA8 unorm
+  static constexpr VkFormat positionFormat = VK_FORMAT_R16G16B16A16_SFLOAT;
+  static constexpr VkFormat normalFormat = VK_FORMAT_R16G16_SNORM;
+  static constexpr VkFormat colorFormat = VK_FORMAT_R8G8B8A8_UNORM;
+
+  static Position encodePosition(const glm::vec3 &position);
+  static Normal encodeNormal(const glm::vec3 &normal);
+  static Color encodeColor(const glm::vec3 &color);
+};
+
+// a vertex as stored in the vertex buffer
+template <typename Encoding, bool HasColor> struct PackedVertex {
+  typename Encoding::Position position;
+  typename Encoding::Normal normal;
+};
+
+template <typename Encoding> struct PackedVertex<Encoding, true> {
+  typename Encoding::Position position;
+  typename Encoding::Normal normal;
+  typename Encoding::Color color;
+};
+
+/**
+ * Describes how a Vertex is stored in the vertex buffer: the GPU-side
+ * struct, the conversion to it and the matching vertex input attributes.
+ * Without HasColor the colour attribute is dropped; the colour of a node
+ * then comes from its NodeUniforms only. The attribute locations match
+ * shaders/triangle.vert.
+ */
+template <VertexLayout Layout, bool HasColor> struct VertexTraits {
+  using Encoding = VertexEncoding<Layout>;
+  using GpuVertex = PackedVertex<Encoding, HasColor>;
+
+  static GpuVertex encode(const Vertex &vertex) {
+    GpuVertex encoded;
+    encoded.position = Encoding::encodePosition(vertex.position);
+    encoded.normal = Encoding::encodeNormal(vertex.normal);
+    if constexpr (HasColor) {
+      encoded.color = Encoding::encodeColor(vertex.color);
+    }
+    return encoded;
+  }
+
+  static constexpr std::array<VkVertexInputAttributeDescription,
+                              HasColor ? 3 : 2>
+      attributes = [] {
+        std::array<VkVertexInputAttributeDescription, HasColor ? 3 : 2>
+            descriptions{};
+        descriptions[0] = {.location = 0,
+                           .binding = 0,
+                           .format = Encoding::positionFormat,
+                           .offset = offsetof(GpuVertex, position)};
+        descriptions[1] = {.location = 1,
+                           .binding = 0,
+                           .format = Encoding::normalFormat,
+                           .offset = offsetof(GpuVertex, normal)};
+        if constexpr (HasColor) {
+          descriptions[2] = {.location = 2,
+                             .binding = 0,
+                             .format = Encoding::colorFormat,
+                             .offset = offsetof(GpuVertex, color)};
+        }
+        return descriptions;
+      }();
+};
+
+static_assert(sizeof(VertexTraits<VertexLayout::Float, true>::GpuVertex) ==
+              sizeof(Vertex));
+static_assert(
+    sizeof(VertexTraits<VertexLayout::Compact, true>::GpuVertex) == 16);
+static_assert(
+    sizeof(VertexTraits<VertexLayout::Compact, false>::GpuVertex) == 12);
+
+// map a unit vector onto the [-1, 1] square of an octahedron and back; the
+// shaders decode in the same way
+glm::vec2 octahedralEncode(const glm::vec3 &normal);
+glm::vec3 octahedralDecode(const glm::vec2 &encoded);
+
+// layout selected with the SCENEGRAPH_VERTEX_LAYOUT and
+// SCENEGRAPH_VERTEX_COLOR CMake options; the shaders are compiled for the
+// same layout
+#if defined(SCENEGRAPH_VERTEX_COLOR)
+inline constexpr bool VERTEX_HAS_COLOR = true;
+#else
+inline constexpr bool VERTEX_HAS_COLOR = false;
+#endif
+#if defined(SCENEGRAPH_VERTEX_LAYOUT_COMPACT)
+using ActiveVertexTraits =
+    VertexTraits<VertexLayout::Compact, VERTEX_HAS_COLOR>;
+#else
+using ActiveVertexTraits = VertexTraits<VertexLayout::Float, VERTEX_HAS_COLOR>;
+#endif
+using GpuVertex = ActiveVertexTraits::GpuVertex;
+
+// convert vertices to the vertex buffer format into encoded, which is reused
+// across calls so that it only allocates when it has to grow
+void encodeVertices(std::span<const Vertex> vertices,
+                    std::vector<GpuVertex> &encoded);
+// narrow the indices of a mesh with hasShortIndices() into narrowed, reused
+// in the same way
+void narrowIndices(std::span<const IndexType> indices,
+                   std::vector<uint16_t> &narrowed);
+
+// vertices and indices of one level of detail as copied to the geometry
+// buffers
+struct GeometryUpload {
+  std::span<const GpuVertex> vertices;
+  // 16-bit or 32-bit indices
+  std::span<const std::byte> indices;
+};
+
+// convert a level of detail for upload, with 16-bit indices if shortIndices;
+// the result points into encoded and narrowed, reused as above, or into the
+// mesh itself, and is valid until the next call
+GeometryUpload prepareGeometryUpload(const Mesh &lod, bool shortIndices,
+                                     std::vector<GpuVertex> &encoded,
+                                     std::vector<uint16_t> &narrowed);
+
+#endif